@@ -0,0 +1,273 @@
+//
+// Batch planner: packs many cut-list files in one process and writes one JSON line per order.
+//
+//   PackingBatch [--engine shelf|maxrects|guillotine] [--out plans.jsonl] [--threads N]
+//                [--list orders.txt] [--export dir] [--formats svg,dxf,png] [--band-allowance 1]
+//                [--stock stock.txt] [--remnants store.rmn] [--min-leftover 100,300]
+//                [--verbose] order1.txt order2.txt ...
+//
+// --list names a file with one order path per line. Lines come out in the order the files were given:
+//   {"order":"a.txt","index":0,"sheets":3,"fill":0.91,"lower_bound":3,"hash":"...","ms":1.2,"parts":[[id,sheet,x,y,w,h,turned],...]}
+// Sizes and positions are real ones, without the saw width, turned is 1 for a part lying turned by
+// 90 degrees, hash is the plan_hash of the plan and stays the same for the same order on every run.
+// An order that can't be read or packed gives {"order":...,"index":...,"error":"..."} and the exit code is 1.
+//
+// --export writes dir/<order file name>_<sheet>.svg/.dxf/.png for every sheet, svg and png unless
+// --formats says otherwise. Previews are drawn on a pool of their own, one sheet per thread.
+//
+// --band-allowance cuts every part that much bigger on each banded edge, for the edge bander to mill off.
+// The plan then has the sizes the parts are cut at.
+//
+// --stock cuts every order from an inventory of boards instead of the sheet in its file, at the least
+// cost. The file has one "width height count cost" line per board kind, count -1 for as many as needed.
+// Every order gets the whole inventory. Lines then also have "cost" and "stock", the inventory line
+// (from 0) every sheet is cut from, and no lower_bound. Sheets differ in size, so --export can't go with it.
+//
+// --remnants keeps the usable leftovers of every plan in a remnant store file, pieces with a short side
+// of at least 100 and a long side of at least 300 unless --min-leftover says otherwise. Lines get
+// "leftovers", the number kept. With --stock the remnants in the store are offered too, at no cost, and
+// the ones cut up are marked used: "remnants" lists them as [sheet, remnant id] and their "stock" is -1.
+// Orders then run one at a time, so every order sees what the ones before it took and left.
+//
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "Batch.h"
+#include "PlanExport.h"
+#include "../thirdparty/json.hpp"
+#include <map>
+#include <memory>
+#include <filesystem>
+#include <sstream>
+
+using json = nlohmann::json;
+
+const map<string, PackEngine> engines = {
+	{ "shelf", SHELF }, { "maxrects", MAXRECTS }, { "guillotine", GUILLOTINE } };
+const map<string, int> formats = {
+	{ "svg", EXPORT_SVG }, { "dxf", EXPORT_DXF }, { "png", EXPORT_PNG } };
+
+struct batch_options
+{
+	PackEngine engine = SHELF;
+	string out;
+	unsigned int threads = 0;
+	bool verbose = false;
+	string export_dir;
+	int formats = EXPORT_SVG | EXPORT_PNG;
+	int band_allowance = 0;
+	vector<stock_sheet> stock;
+	string remnants;
+	int min_short = 100;
+	int min_long = 300;
+	vector<string> orders;
+};
+
+batch_options parse_args(int argc, char** argv)
+{
+	batch_options o;
+	for (int i = 1; i < argc; ++i)
+	{
+		string arg = argv[i];
+		if (arg == "--verbose")
+		{
+			o.verbose = true;
+			continue;
+		}
+		if (arg.rfind("--", 0) != 0)
+		{
+			o.orders.push_back(arg);
+			continue;
+		}
+		if (i + 1 >= argc)
+			throw runtime_error("Missing value for " + arg);
+		string value = argv[++i];
+		if (arg == "--engine")
+		{
+			if (!engines.count(value)) throw runtime_error("Unknown engine " + value);
+			o.engine = engines.at(value);
+		}
+		else if (arg == "--out") o.out = value;
+		else if (arg == "--threads") o.threads = stoul(value);
+		else if (arg == "--export") o.export_dir = value;
+		else if (arg == "--stock") o.stock = read_stock(value);
+		else if (arg == "--remnants") o.remnants = value;
+		else if (arg == "--min-leftover")
+		{
+			size_t comma = value.find(',');
+			if (comma == string::npos) throw runtime_error("--min-leftover expects SHORT,LONG");
+			o.min_short = stoi(value.substr(0, comma));
+			o.min_long = stoi(value.substr(comma + 1));
+		}
+		else if (arg == "--band-allowance")
+		{
+			o.band_allowance = stoi(value);
+			if (o.band_allowance < 0) throw runtime_error("Negative band allowance " + value);
+		}
+		else if (arg == "--formats")
+		{
+			o.formats = 0;
+			stringstream ss(value);
+			string format;
+			while (getline(ss, format, ','))
+			{
+				if (!formats.count(format)) throw runtime_error("Unknown format " + format);
+				o.formats |= formats.at(format);
+			}
+		}
+		else if (arg == "--list")
+		{
+			ifstream is(value);
+			if (!is)
+				throw runtime_error("Can't open " + value);
+			string line;
+			while (getline(is, line))
+			{
+				if (!line.empty() && (line.back() == '\r')) line.pop_back();
+				if (!line.empty()) o.orders.push_back(line);
+			}
+		}
+		else throw runtime_error("Unknown option " + arg);
+	}
+	if (!o.stock.empty() && !o.export_dir.empty())
+		throw runtime_error("--export can't be used with --stock");
+	//an order may take remnants the one before it left
+	if (!o.stock.empty() && !o.remnants.empty())
+		o.threads = 1;
+	return o;
+}
+
+json plan_to_json(const batch_plan& plan)
+{
+	json j = { { "order", plan.name }, { "index", plan.index } };
+	if (!plan.error.empty())
+	{
+		j["error"] = plan.error;
+		return j;
+	}
+	j["sheets"] = plan.total_count;
+	j["fill"] = plan.percentage;
+	if (plan.sheet_stock.empty())
+		j["lower_bound"] = plan.sheet_bound;
+	else
+	{
+		j["cost"] = plan.cost;
+		j["stock"] = plan.sheet_stock;
+	}
+	j["hash"] = hash_string(plan_hash(plan.parts));
+	j["ms"] = plan.ms;
+	json parts = json::array();
+	for (auto& r : plan.parts)
+		parts.push_back({ r.id, r.dspN, r.x, r.y, r.width - plan.saw_width, r.height - plan.saw_width, (int)r.is_rotated() });
+	j["parts"] = move(parts);
+	return j;
+}
+
+int main(int argc, char** argv)
+{
+	try
+	{
+		batch_options o = parse_args(argc, argv);
+		ofstream file;
+		if (!o.out.empty())
+		{
+			file.open(o.out);
+			if (!file)
+				throw runtime_error("Can't open " + o.out);
+		}
+		ostream& out = o.out.empty() ? cout : file;
+		unique_ptr<worker_pool> own;
+		if (o.threads > 0)
+			own = make_unique<worker_pool>(o.threads);
+		worker_pool& pool = own ? *own : worker_pool::shared();
+		unique_ptr<worker_pool> exporter;
+		if (!o.export_dir.empty())
+		{
+			//Previews are flat colour, row filters gain next to nothing on them and trying all five for every
+			//row was half the time, so was the deeper match search. Set once, before any export thread runs
+			stbi_write_force_png_filter = 0;
+			stbi_write_png_compression_level = 4;
+			filesystem::create_directories(o.export_dir);
+			exporter = make_unique<worker_pool>(pool.size());
+		}
+		unique_ptr<remnant_store> store;
+		if (!o.remnants.empty())
+			store = make_unique<remnant_store>(o.remnants);
+		//remnant every inventory entry after o.stock stands for, per order
+		vector<vector<uint32_t>> remnant_ids(o.orders.size());
+
+		bool failed = false;
+		auto start = chrono::steady_clock::now();
+		pack_batch(o.orders.size(), [&](size_t i, batch_order& order)
+		{
+			order.name = o.orders[i];
+			order.parts = read_input(o.orders[i], order.dsp_w, order.dsp_h, order.saw_width);
+			add_band_allowance(order.parts, o.band_allowance);
+			order.stock = o.stock;
+			if (store)
+			{
+				order.keep_leftovers = true;
+				order.min_short = o.min_short;
+				order.min_long = o.min_long;
+				if (!o.stock.empty())
+					store->inventory(0, order.stock, remnant_ids[i]);
+			}
+		}, o.engine, [&](const batch_plan& plan)
+		{
+			json j = plan_to_json(plan);
+			if (store && plan.error.empty())
+			{
+				json taken = json::array();
+				for (int s = 0; s < plan.sheet_stock.size(); ++s)
+				{
+					if (plan.sheet_stock[s] < o.stock.size())
+						continue;
+					uint32_t id = remnant_ids[plan.index][plan.sheet_stock[s] - o.stock.size()];
+					store->take(id);
+					taken.push_back({ s, id });
+					j["stock"][s] = -1;
+				}
+				if (!o.stock.empty())
+					j["remnants"] = move(taken);
+				store->add_leftovers(plan.leftovers, plan.index);
+				j["leftovers"] = plan.leftovers.size();
+			}
+			//order names come from the file system and needn't be UTF-8, bad bytes become U+FFFD
+			out << j.dump(-1, ' ', false, json::error_handler_t::replace) << "\n";
+			failed = failed || !plan.error.empty();
+			if (exporter && plan.error.empty())
+			{
+				try
+				{
+					export_plan(plan.parts, plan.dsp_w, plan.dsp_h, plan.saw_width, o.export_dir, filesystem::path(plan.name).stem().string(), o.formats, 800, *exporter);
+				}
+				catch (const exception& e)
+				{
+					cerr << plan.name << ": " << e.what() << "\n";
+					failed = true;
+				}
+			}
+			if (o.verbose)
+			{
+				if (plan.error.empty())
+					cerr << plan.name << ": " << plan.total_count << " sheets, bound " << plan.sheet_bound << ", " << plan.ms << "ms\n";
+				else
+					cerr << plan.name << ": " << plan.error << "\n";
+			}
+		}, pool);
+		out << flush;
+		if (store)
+			store->flush();
+		if (o.verbose)
+			cerr << o.orders.size() << " orders in " << chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() << "ms" << endl;
+		return failed ? 1 : 0;
+	}
+	catch (const char* e)
+	{
+		cerr << "[ERROR] " << e << endl;
+	}
+	catch (const exception& e)
+	{
+		cerr << "[ERROR] " << e.what() << endl;
+	}
+	return 2;
+}
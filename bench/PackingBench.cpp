@@ -0,0 +1,209 @@
+//
+// Packing benchmark: runs every engine on seeded random orders and prints one JSON line per run.
+//
+//   PackingBench [--sizes 1000,10000,100000] [--dists uniform,small,mixed,strips]
+//                [--engines shelf,maxrects,guillotine,stream] [--seed 1] [--repeat 3]
+//                [--dsp 3000x2000] [--saw 10] [--compare baseline.jsonl] [--tolerance 0.2] [--identical]
+//
+// lower_bound is the fewest sheets any plan can use, so sheets - lower_bound is the most
+// that more compute could still save. hash is the plan_hash of the plan, runs are seeded and every
+// engine is deterministic, so a build that packs the same way prints the same hash.
+//
+// stream feeds the order part by part into a stream_packer, which never holds the whole order, and is
+// not in the default engines. Its lines also have peak_parts, the most parts it held at once.
+//
+// 1M parts is left out of the default sweep: a single run of one engine takes minutes at that size,
+// the whole default grid would take hours. Add it with --sizes 1000,10000,100000,1000000.
+//
+// With --compare every run is matched with the same (engine, dist, n, seed) line of an earlier
+// output. More sheets, or time over baseline * (1 + tolerance), is reported and the exit code is 1.
+// same_plan tells if the hash matched, with --identical a different plan is a regression too.
+//
+
+#include "Algorythm.h"
+#include "StreamPacker.h"
+#include "../thirdparty/json.hpp"
+#include <map>
+#include <sstream>
+
+using json = nlohmann::json;
+
+struct bench_options
+{
+	vector<int> sizes = { 1000, 10000, 100000 };
+	vector<string> dists = { "uniform", "small", "mixed", "strips" };
+	vector<string> engines = { "shelf", "maxrects", "guillotine" };
+	unsigned int seed = 1;
+	int repeat = 3;
+	int dsp_w = 3000;
+	int dsp_h = 2000;
+	int saw_width = 10;
+	string compare;
+	double tolerance = 0.2;
+	bool identical = false;
+};
+
+vector<string> split_list(const string& s)
+{
+	vector<string> items;
+	stringstream ss(s);
+	string item;
+	while (getline(ss, item, ','))
+		if (!item.empty()) items.push_back(item);
+	return items;
+}
+
+const map<string, SizeDistribution> distributions = {
+	{ "uniform", UNIFORM }, { "small", SMALL_PARTS }, { "mixed", MIXED }, { "strips", STRIPS } };
+const map<string, PackEngine> engines = {
+	{ "shelf", SHELF }, { "maxrects", MAXRECTS }, { "guillotine", GUILLOTINE } };
+
+bench_options parse_args(int argc, char** argv)
+{
+	bench_options o;
+	for (int i = 1; i < argc; ++i)
+	{
+		string arg = argv[i];
+		if (arg == "--identical")
+		{
+			o.identical = true;
+			continue;
+		}
+		if (i + 1 >= argc)
+			throw runtime_error("Missing value for " + arg);
+		string value = argv[++i];
+		if (arg == "--sizes")
+		{
+			o.sizes.clear();
+			for (auto& n : split_list(value)) o.sizes.push_back(stoi(n));
+		}
+		else if (arg == "--dists") o.dists = split_list(value);
+		else if (arg == "--engines") o.engines = split_list(value);
+		else if (arg == "--seed") o.seed = stoul(value);
+		else if (arg == "--repeat") o.repeat = max(1, stoi(value));
+		else if (arg == "--dsp")
+		{
+			auto x = value.find('x');
+			if (x == string::npos) throw runtime_error("--dsp expects WxH");
+			o.dsp_w = stoi(value.substr(0, x));
+			o.dsp_h = stoi(value.substr(x + 1));
+		}
+		else if (arg == "--saw") o.saw_width = stoi(value);
+		else if (arg == "--compare") o.compare = value;
+		else if (arg == "--tolerance") o.tolerance = stod(value);
+		else throw runtime_error("Unknown option " + arg);
+	}
+	for (auto& d : o.dists)
+		if (!distributions.count(d)) throw runtime_error("Unknown distribution " + d);
+	for (auto& e : o.engines)
+		if (!engines.count(e) && (e != "stream")) throw runtime_error("Unknown engine " + e);
+	return o;
+}
+
+string run_key(const json& j)
+{
+	return j["engine"].get<string>() + "/" + j["dist"].get<string>() + "/" + to_string(j["n"].get<int>()) + "/" + to_string(j["seed"].get<unsigned int>());
+}
+
+map<string, json> read_baseline(const string& path)
+{
+	map<string, json> baseline;
+	ifstream is(path);
+	if (!is)
+		throw runtime_error("Can't open baseline " + path);
+	string line;
+	while (getline(is, line))
+	{
+		if (line.empty()) continue;
+		json j = json::parse(line);
+		baseline[run_key(j)] = j;
+	}
+	return baseline;
+}
+
+int main(int argc, char** argv)
+{
+	try
+	{
+		bench_options o = parse_args(argc, argv);
+		map<string, json> baseline;
+		if (!o.compare.empty())
+			baseline = read_baseline(o.compare);
+		bool regressed = false;
+
+		for (auto& dist : o.dists)
+		{
+			for (int n : o.sizes)
+			{
+				vector<Rectangle> given = cast_input_vector(generate_order(n, o.seed, distributions.at(dist), o.dsp_w, o.dsp_h));
+				vector<Rectangle> data = given;
+				fit_to_dsp(data, o.dsp_w, o.dsp_h);
+				vector<Rectangle> best;
+				pack_context ctx;
+				for (auto& engine : o.engines)
+				{
+					int total_count = 0;
+					double percentage = 0;
+					double best_ms = 0;
+					size_t peak_parts = 0;
+					for (int r = 0; r < o.repeat; ++r)
+					{
+						auto start = chrono::steady_clock::now();
+						if (engine == "stream")
+						{
+							//stream_packer turns the parts itself, like it would parts read from a file
+							best.clear();
+							stream_packer packer(o.dsp_w, o.dsp_h, o.saw_width, [&](int, span<const Rectangle> parts)
+							{
+								best.insert(best.end(), parts.begin(), parts.end());
+							});
+							for (auto& part : given)
+								packer.add(part);
+							packer.finish(total_count, percentage);
+							peak_parts = packer.peak_parts();
+						}
+						else
+							pack(data, o.dsp_w, o.dsp_h, o.saw_width, engines.at(engine), total_count, percentage, best, ctx);
+						auto finish = chrono::steady_clock::now();
+						double ms = chrono::duration<double, milli>(finish - start).count();
+						if ((r == 0) || (ms < best_ms)) best_ms = ms;
+					}
+					json j = {
+						{ "engine", engine }, { "dist", dist }, { "n", n }, { "seed", o.seed },
+						{ "ms", best_ms }, { "sheets", total_count }, { "fill", percentage }, { "lower_bound", ctx.sheet_bound },
+						{ "hash", hash_string(plan_hash(best)) } };
+					if (engine == "stream")
+					{
+						j["lower_bound"] = sheet_lower_bound(span<const Rectangle>(data), o.dsp_w, o.dsp_h, o.saw_width, ctx.bound_scratch);
+						j["peak_parts"] = peak_parts;
+					}
+
+					auto base = baseline.find(run_key(j));
+					if (base != baseline.end())
+					{
+						int base_sheets = base->second["sheets"];
+						double base_ms = base->second["ms"];
+						j["base_sheets"] = base_sheets;
+						j["base_ms"] = base_ms;
+						//baselines from before the hash was printed can't tell
+						bool same_plan = !base->second.contains("hash") || (base->second["hash"] == j["hash"]);
+						j["same_plan"] = same_plan;
+						j["regressed"] = (total_count > base_sheets) || (best_ms > base_ms * (1 + o.tolerance)) || (o.identical && !same_plan);
+						regressed = regressed || j["regressed"].get<bool>();
+					}
+					cout << j.dump() << "\n" << flush;
+				}
+			}
+		}
+		return regressed ? 1 : 0;
+	}
+	catch (const char* e)
+	{
+		cerr << "[ERROR] " << e << endl;
+	}
+	catch (const exception& e)
+	{
+		cerr << "[ERROR] " << e.what() << endl;
+	}
+	return 2;
+}
@@ -5,11 +5,44 @@
 #include <algorithm>
 #include <random>
 #include <chrono>
+#include <thread>
+#include <atomic>
+#include <span>
+#include "LevelIndex.h"
+#include "WorkerPool.h"
+#include "MaxRects.h"
+#include "Guillotine.h"
+#include "MappedFile.h"
+#include "Bounds.h"
+#include <set>
+#include <tuple>
+#include <string_view>
+#include <charconv>
+#include <climits>
+#include <cctype>
+#include <stdexcept>
+#include <cstdio>
 using namespace std;
 
+//Which way the wood grain of a part has to run. The grain of a dsp list runs along its width,
+//a part with grain is turned to match it and then can't turn anymore, see fit_part_to_dsp
+enum Grain
+{
+    GRAIN_NONE,
+    GRAIN_ALONG_WIDTH,
+    GRAIN_ALONG_HEIGHT,
+    GRAIN_ALONG_LENGTH, //along the longer side, whichever that is
+};
+
 class Rectangle
 {
 private:
+    void turn_grain()
+    {
+        if (grain == GRAIN_ALONG_WIDTH) grain = GRAIN_ALONG_HEIGHT;
+        else if (grain == GRAIN_ALONG_HEIGHT) grain = GRAIN_ALONG_WIDTH;
+    }
+
     void rotate_plus90()
     {
         unsigned int t;
@@ -21,6 +54,7 @@ private:
         west_canted = south_canted;
         south_canted = east_canted;
         east_canted = t2;
+        turn_grain();
         rotated = true;
     }
 
@@ -36,6 +70,7 @@ private:
         east_canted = south_canted;
         south_canted = west_canted;
         west_canted = t2;
+        turn_grain();
 
         rotated = false;
     }
@@ -65,7 +100,10 @@ public:
     unsigned int height;
     unsigned int x;
     unsigned int y;
-    unsigned int dspN;
+    unsigned int dspN = 0;
+    //place of the part in the order it came from, sorting the plan keeps it
+    unsigned int id = 0;
+    Grain grain = GRAIN_NONE;
     void rotate()
     {
         if (rotatable)
@@ -75,31 +113,160 @@ public:
     {
         rotatable = false;
     }
+    bool is_rotatable() const
+    {
+        return rotatable;
+    }
+    //true if the part lies turned by 90 degrees against the order, the canted flags are already turned with it
+    bool is_rotated() const
+    {
+        return rotated;
+    }
 };
 
-vector <Rectangle> read_input(string filepath, int& dsp_w, int& dsp_h, int& saw_width)
+enum PackEngine
 {
-    ifstream is(filepath);
-    vector <Rectangle> data;
-    is >> dsp_w >> dsp_h >> saw_width;
-    int n = 0;
-    is >> n;
-    bool nc, ec, sc, wc;
-    int w, h;
+    SHELF,
+    MAXRECTS,
+    GUILLOTINE,
+};
 
-    for (int i = 0; i < n; ++i)
-    {
-        is >> w >> h >> nc >> ec >> sc >> wc;
-        Rectangle r(nc, ec, sc, wc, w, h);
-        data.push_back(r);
-    }
-    is.close();
-    return data;
+//Walks a cut-list text and counts lines, so a bad value can be reported where it is
+class input_parser
+{
+private:
+	const char* p;
+	const char* end;
+	int line = 1;
+
+	void skip_blanks()
+	{
+		while ((p != end) && ((*p == ' ') || (*p == '\t') || (*p == '\r')))
+			++p;
+	}
+
+public:
+	explicit input_parser(string_view text) : p(text.data()), end(text.data() + text.size()) {}
+
+	[[noreturn]] void fail(const string& what) const
+	{
+		throw runtime_error("line " + to_string(line) + ": " + what);
+	}
+
+	//Moves to the first line that has something on it, false at the end of the text
+	bool next_line()
+	{
+		while (true)
+		{
+			skip_blanks();
+			if (p == end)
+				return false;
+			if (*p != '\n')
+				return true;
+			++p; ++line;
+		}
+	}
+
+	int read_int(const char* name, int min_value, int max_value)
+	{
+		skip_blanks();
+		if ((p == end) || (*p == '\n'))
+			fail(string("missing ") + name);
+		int value = 0;
+		auto [next, ec] = from_chars(p, end, value);
+		if ((ec != errc()) || ((next != end) && !isspace((unsigned char)*next)))
+			fail(string("bad ") + name + " '" + string(p, find_if(p, end, [](char c) { return isspace((unsigned char)c); })) + "'");
+		if ((value < min_value) || (value > max_value))
+			fail(string(name) + " " + to_string(value) + " is out of range " + to_string(min_value) + ".." + to_string(max_value));
+		p = next;
+		return value;
+	}
+
+	//true if there is another value on this line
+	bool more_on_line()
+	{
+		skip_blanks();
+		return (p != end) && (*p != '\n');
+	}
+
+	void end_line()
+	{
+		skip_blanks();
+		if ((p != end) && (*p != '\n'))
+			fail("unexpected '" + string(p, find(p, end, '\n')) + "' at the end of the line");
+	}
+};
+
+//First lines of a cut-list: "dsp_w dsp_h saw_width", then the part count, which is returned
+int read_header(input_parser& in, int& dsp_w, int& dsp_h, int& saw_width)
+{
+	if (!in.next_line())
+		in.fail("empty input");
+	dsp_w = in.read_int("dsp width", 1, INT_MAX);
+	dsp_h = in.read_int("dsp height", 1, INT_MAX);
+	saw_width = in.read_int("saw width", 0, INT_MAX);
+	in.end_line();
+	if (!in.next_line())
+		in.fail("missing part count");
+	int n = in.read_int("part count", 0, INT_MAX);
+	in.end_line();
+	return n;
+}
+
+//One "w h nc ec sc wc [grain]" part line, grain is a Grain value and 0 if left out
+Rectangle read_part(input_parser& in, unsigned int id)
+{
+	int w = in.read_int("part width", 1, INT_MAX);
+	int h = in.read_int("part height", 1, INT_MAX);
+	bool nc = in.read_int("north edge flag", 0, 1);
+	bool ec = in.read_int("east edge flag", 0, 1);
+	bool sc = in.read_int("south edge flag", 0, 1);
+	bool wc = in.read_int("west edge flag", 0, 1);
+	Grain grain = in.more_on_line() ? (Grain)in.read_int("grain", GRAIN_NONE, GRAIN_ALONG_LENGTH) : GRAIN_NONE;
+	in.end_line();
+	Rectangle r(nc, ec, sc, wc, w, h);
+	r.id = id;
+	r.grain = grain;
+	return r;
+}
+
+//Cut-list format: the header, then one part line per part. Parts are appended to data
+void parse_input(string_view text, int& dsp_w, int& dsp_h, int& saw_width, vector <Rectangle>& data)
+{
+	input_parser in(text);
+	int n = read_header(in, dsp_w, dsp_h, saw_width);
+	//the count is only trusted as far as the text can hold it, the shortest part line "1 1 0 0 0 0"
+	//takes 12 bytes. A count too big for the file then fails below with its line, not in reserve()
+	data.reserve(data.size() + min<size_t>(n, text.size() / 12 + 1));
+	for (int i = 0; i < n; ++i)
+	{
+		if (!in.next_line())
+			in.fail("expected " + to_string(n) + " parts, got " + to_string(i));
+		data.push_back(read_part(in, data.size()));
+	}
+	if (in.next_line())
+		in.fail("more parts than the count of " + to_string(n));
 }
 
-vector <Rectangle> cast_input_vector(vector<vector<int>> input)
+vector <Rectangle> read_input(string filepath, int& dsp_w, int& dsp_h, int& saw_width)
 {
+	mapped_file file(filepath);
 	vector <Rectangle> data;
+	try
+	{
+		parse_input(file.text(), dsp_w, dsp_h, saw_width, data);
+	}
+	catch (const runtime_error& e)
+	{
+		throw runtime_error(filepath + ", " + e.what());
+	}
+	return data;
+}
+
+vector <Rectangle> cast_input_vector(const vector<vector<int>>& input)
+{
+	vector <Rectangle> data;
+	data.reserve(input.size());
 	for (int i = 0; i < input.size(); ++i)
 	{
 		int nc = input[i][0];
@@ -109,40 +276,152 @@ vector <Rectangle> cast_input_vector(vector<vector<int>> input)
 		int w = input[i][4];
 		int h = input[i][5];
 		Rectangle r(nc, ec, sc, wc, w, h);
+		r.id = i;
+		//optional 7th value is the grain
+		if (input[i].size() > 6)
+			r.grain = (Grain)input[i][6];
 		data.push_back(r);
 	}
 	return data;
 }
-void write_output(vector <Rectangle> data, int total_count, double percantage, int dsp_h)
+//Fingerprint of a plan: every part is hashed from its id, list, place, size and turn, and the part
+//hashes are added up, so it doesn't depend on the order parts are listed in. Two runs gave the
+//same layout iff they give the same hash (up to collisions)
+unsigned long long plan_hash(span<const Rectangle> data)
+{
+    auto mix = [](unsigned long long h)
+    {
+        h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+        return h ^ (h >> 31);
+    };
+    unsigned long long total = data.size();
+    for (auto& r : data)
+    {
+        unsigned long long h = r.id;
+        for (unsigned long long v : { (unsigned long long)r.dspN, (unsigned long long)r.x, (unsigned long long)r.y,
+            (unsigned long long)r.width, (unsigned long long)r.height, (unsigned long long)r.is_rotated() })
+            h = mix(h * 0x9e3779b97f4a7c15ULL + v);
+        total += mix(h);
+    }
+    return total;
+}
+
+//plan_hash as 16 hex digits, the form it is printed in
+string hash_string(unsigned long long hash)
+{
+    char text[17];
+    snprintf(text, sizeof(text), "%016llx", hash);
+    return text;
+}
+
+void write_part(ostream& os, const Rectangle& r)
+{
+    os << "Rectangle w/h = " << r.width << " " << r.height << "Rectangle x/y =" << r.x << " " << r.y << " DSP#" << r.dspN << "\n";
+}
+
+//sheet_bound > 0 adds the lower bound and how far the plan is from it
+void write_output(span<const Rectangle> data, int total_count, double percantage, int sheet_bound = 0)
 {
-    cout << "Total DSP count = " << total_count << " , Fill percentage = " << percantage << endl;
+    cout << "Total DSP count = " << total_count << " , Fill percentage = " << percantage;
+    if (sheet_bound > 0)
+        cout << " , Lower bound = " << sheet_bound << " , Gap = " << total_count - sheet_bound;
+    cout << " , Plan hash = " << hash_string(plan_hash(data)) << endl;
     for (int i = 0; i < data.size(); ++i)
+        write_part(cout, data[i]);
+    cout << flush;
+}
+
+void write_cuts(const vector <guillotine_sheet>& sheets)
+{
+    for (int i = 0; i < sheets.size(); ++i)
     {
-        Rectangle r = data[i];
-        cout << "Rectangle w/h = " << r.width << " " << r.height << "Rectangle x/y =" << r.x << " " << r.y << " DSP#" << r.dspN << endl;
+        cout << "DSP#" << i << " cuts:" << "\n";
+        for (auto& c : sheets[i].cut_sequence())
+            cout << (c.vertical ? "Vertical x = " : "Horizontal y = ") << c.position << " from " << c.from << " length " << c.length << "\n";
     }
+    cout << flush;
+}
+
+//Random orders for testing and benchmarking, every part fits a dsp_w x dsp_h list
+enum SizeDistribution
+{
+    UNIFORM,     //both sides 50..1500
+    SMALL_PARTS, //both sides 50..400
+    MIXED,       //every fifth part is big, the rest are small
+    STRIPS,      //long narrow parts
+};
+
+//Parts in cast_input_vector format: nc ec sc wc w h
+vector<vector<int>> generate_order(int n, unsigned int seed, SizeDistribution distribution = UNIFORM, int dsp_w = 3000, int dsp_h = 2000)
+{
+	mt19937 gen(seed);
+	int longest = min(dsp_w, dsp_h);
+	uniform_int_distribution<int> uniform(50, min(1500, longest));
+	uniform_int_distribution<int> small(50, min(400, longest));
+	uniform_int_distribution<int> big(min(600, longest), longest);
+	uniform_int_distribution<int> narrow(50, min(200, longest));
+	uniform_int_distribution<int> pick(0, 4);
+	vector<vector<int>> order(n);
+	for (int i = 0; i < n; ++i)
+	{
+		int w = 0, h = 0;
+		switch (distribution)
+		{
+		case SMALL_PARTS:
+			w = small(gen); h = small(gen);
+			break;
+		case MIXED:
+			if (pick(gen) == 0) { w = big(gen); h = big(gen); }
+			else { w = small(gen); h = small(gen); }
+			break;
+		case STRIPS:
+			w = big(gen); h = narrow(gen);
+			if (pick(gen) < 2) swap(w, h);
+			break;
+		default:
+			w = uniform(gen); h = uniform(gen);
+			break;
+		}
+		order[i] = { 0, 0, 0, 0, w, h };
+	}
+	return order;
 }
 
-void generate_some_file(string path)
+//Same seed, same file, pass a random_device value for a fresh one
+void generate_some_file(string path, int n = 5000, unsigned int seed = 1, SizeDistribution distribution = UNIFORM)
 {
 	ofstream os(path);
 	os << 3000 << " " << 2000 << " " << 10 << endl;
-	int n = 5000;
 	os << n << endl;
-	random_device rd;
-	mt19937 gen(rd());
-	uniform_int_distribution<int> uid(50, 1500);
-
-	for (int i = 0; i < n; ++i)
+	for (auto& part : generate_order(n, seed, distribution, 3000, 2000))
 	{
-		os << uid(gen) << " " << uid(gen) << " " <<  0 << " " << 0 << " " << 0 << " " << 0 << endl;
+		os << part[4] << " " << part[5] << " " << part[0] << " " << part[1] << " " << part[2] << " " << part[3] << endl;
 	}
 	os.close();
 }
-bool comp(Rectangle r1, Rectangle r2)
+bool comp(const Rectangle& r1, const Rectangle& r2)
 {
 	return r1.height > r2.height;
 }
+//Sort keys, packers go from the biggest key down
+typedef unsigned int (*sort_key)(const Rectangle&);
+unsigned int key_height(const Rectangle& r)
+{
+	return r.height;
+}
+unsigned int key_area(const Rectangle& r)
+{
+	return r.width * r.height;
+}
+unsigned int key_long_side(const Rectangle& r)
+{
+	return max(r.width, r.height);
+}
+unsigned int key_width(const Rectangle& r)
+{
+	return r.width;
+}
 struct level
 {
 	int cell_h = 0;
@@ -151,7 +430,46 @@ struct level
 	int height = 0;
 
 };
-long long total_square(vector <Rectangle> data)
+//Levels of BF kept as one array per field
+struct level_table
+{
+	vector <int> cell_h;
+	vector <int> curr_w;
+	vector <int> space_left;
+	vector <int> height;
+
+	size_t size() const
+	{
+		return height.size();
+	}
+	void clear()
+	{
+		cell_h.clear(); curr_w.clear(); space_left.clear(); height.clear();
+	}
+	void push_back(const level& l)
+	{
+		cell_h.push_back(l.cell_h);
+		curr_w.push_back(l.curr_w);
+		space_left.push_back(l.space_left);
+		height.push_back(l.height);
+	}
+	//top edge of the last level, everything below it is used by the plan
+	int top() const
+	{
+		return height.empty() ? 0 : cell_h.back() + height.back();
+	}
+};
+//Buffers of one packing pass. They keep their capacity between plans,
+//so once they have grown to the order size a pass does no heap allocations
+struct pack_scratch
+{
+	vector <unsigned long long> keys;
+	vector <Rectangle> sorted;
+	level_table levels;
+	level_index index;
+	vector <int> min_side;
+};
+long long total_square(span<const Rectangle> data)
 {
 	long long total = 0;
 	for (int i = 0; i < data.size(); ++i)
@@ -160,67 +478,65 @@ long long total_square(vector <Rectangle> data)
 	}
 	return total;
 }
-vector <Rectangle> BF(vector <Rectangle> data, int dsp_w, int dsp_h, int& total_count, double& percentage, bool rotate)
+//Sorts by key from the biggest down, equal keys keep their order.
+//Only the key/index pairs are sorted, every rectangle is moved once
+void sort_by_key(span<Rectangle> data, sort_key key, pack_scratch& scratch)
 {
-	sort(data.begin(), data.end(), comp);
-	vector<level> levels;
+	scratch.keys.clear();
+	for (unsigned int i = 0; i < data.size(); ++i)
+		scratch.keys.push_back(((unsigned long long)key(data[i]) << 32) | (0xFFFFFFFFu - i));
+	sort(scratch.keys.begin(), scratch.keys.end(), greater<unsigned long long>());
+	scratch.sorted.clear();
+	for (auto k : scratch.keys)
+		scratch.sorted.push_back(data[0xFFFFFFFFu - (unsigned int)k]);
+	copy(scratch.sorted.begin(), scratch.sorted.end(), data.begin());
+}
+//Places data in the order it is given, scratch.levels keeps the levels afterwards
+void BF_in_order(span<Rectangle> data, int dsp_w, int dsp_h, int& total_count, double& percentage, bool rotate, pack_scratch& scratch)
+{
+	level_table& levels = scratch.levels;
+	levels.clear();
 	level curr;
+	data[0].x = 0; data[0].y = 0;
 	curr.curr_w = data[0].width;
 	curr.space_left = data[0].height * (dsp_w - data[0].width);
 	curr.height = data[0].height;
 	//First highest is placed beforehand, also 1 level is created
 	levels.push_back(curr);
+	level_index& index = scratch.index;
+	index.reset(dsp_w);
+	index.push_back(curr.height, dsp_w - curr.curr_w, curr.space_left);
 
-	//Try to put each rectangle on each lvl it can be put to
-	//and compare how much space is left after placing rectangle there
+	//Put each rectangle on the lvl where the least space is left after placing it
 	//If rectangle cannot be placed a new lvl is added
 	for (int i = 1; i < data.size(); ++i)
 	{
-		int least_space = 2000000000;
-		int best_lvl_number = -1;
-		int curr_space_left = 0;
+		int least_space = 0;
 		//Search for best lvl to fit current rect
-		for (int j = 0; j < levels.size(); ++j)
-		{
-			if ((data[i].height <= levels[j].height) && (data[i].width <= (dsp_w - levels[j].curr_w))) //if rect can fit on curr lvl
-			{
-				curr_space_left = levels[j].space_left - (data[i].height * data[i].width);
-				if (curr_space_left < least_space)
-				{
-					least_space = curr_space_left;
-					best_lvl_number = j;
-				}
-			}
-		}
+		int best_lvl_number = index.find_best(data[i].width, data[i].height, false, least_space);
 		//rotation addition makes algorythm rotate current rectangle in search for its better place
+		//standing rectangle wins equal space, and among equal lvls the last one.
+		//A locked rectangle doesn't turn, but is looked up again all the same: standing, it still goes to the last of equal lvls
 		if (rotate)
 		{
-			bool find_best_rotated = false;
 			data[i].rotate();
-			for (int j = 0; j < levels.size(); ++j)
-			{
-				if ((data[i].height <= levels[j].height) && (data[i].width <= (dsp_w - levels[j].curr_w))) //if rect can fit on curr lvl
-				{
-					curr_space_left = levels[j].space_left - (data[i].height * data[i].width);
-					if ((curr_space_left < least_space) || ((curr_space_left == least_space) && (data[i].height > data[i].width)))
-					{
-						least_space = curr_space_left;
-						best_lvl_number = j;
-						find_best_rotated = true;
-					}
-				}
-			}
-			if (!find_best_rotated) data[i].rotate();
+			int rotated_space = 0;
+			bool standing = data[i].height > data[i].width;
+			int rotated_lvl_number = index.find_best(data[i].width, data[i].height, standing, rotated_space);
+			if ((rotated_lvl_number != -1) && ((best_lvl_number == -1) || (rotated_space < least_space) || (standing && (rotated_space == least_space))))
+				best_lvl_number = rotated_lvl_number;
+			else
+				data[i].rotate();
 		}
 		
 		if (best_lvl_number == -1)
 		{
 			//If cant fit anywhere add new lvl and fit it there
 			level newlevel;
-			newlevel.cell_h = levels[levels.size() - 1].cell_h + levels[levels.size() - 1].height;
+			newlevel.cell_h = levels.top();
 			bool cant_fit = false;
 			//if it cant fit on that dsp list we place this rectangle on next list
-			if ((newlevel.cell_h + data[i].height) / dsp_h > levels[levels.size() - 1].cell_h / dsp_h)
+			if ((newlevel.cell_h + data[i].height) / dsp_h > levels.cell_h.back() / dsp_h)
 			{
 				newlevel.cell_h = newlevel.cell_h + dsp_h - newlevel.cell_h % dsp_h;
 				cant_fit = true;
@@ -234,34 +550,40 @@ vector <Rectangle> BF(vector <Rectangle> data, int dsp_w, int dsp_h, int& total_
 			{
 				//however we still can use that space left
 				level extra;
-				extra.cell_h = levels[levels.size() - 1].cell_h + levels[levels.size() - 1].height;
+				extra.cell_h = levels.top();
 				extra.curr_w = 0;
 				extra.height = newlevel.cell_h - extra.cell_h;
 				extra.space_left = (extra.height * dsp_w );
 				levels.push_back(extra);
+				index.push_back(extra.height, dsp_w - extra.curr_w, extra.space_left);
 			}
 			levels.push_back(newlevel);
+			index.push_back(newlevel.height, dsp_w - newlevel.curr_w, newlevel.space_left);
 		}
 		else
 		{
 			//Fit rect on that lvl
-			data[i].x = levels[best_lvl_number].curr_w;
-			data[i].y = levels[best_lvl_number].cell_h;
-			levels[best_lvl_number].curr_w += data[i].width;
-			levels[best_lvl_number].space_left -= (data[i].height * data[i].width);
+			data[i].x = levels.curr_w[best_lvl_number];
+			data[i].y = levels.cell_h[best_lvl_number];
+			levels.curr_w[best_lvl_number] += data[i].width;
+			levels.space_left[best_lvl_number] -= (data[i].height * data[i].width);
+			index.update(best_lvl_number, dsp_w - levels.curr_w[best_lvl_number], levels.space_left[best_lvl_number]);
 		}
 	}
 	//After evey rectangle is set we calculate dsp count and fill percentage
-	int total_height = (levels[levels.size() - 1].cell_h + levels[levels.size() - 1].height);
+	int total_height = levels.top();
 	total_count = total_height / dsp_h;
-	if ((levels[levels.size() - 1].cell_h + levels[levels.size() - 1].height) % dsp_h > 0) total_count++;
+	if (total_height % dsp_h > 0) total_count++;
     percentage = ((double)total_square(data) / dsp_w) / (dsp_h * total_count);
-	return data;
 }
-vector <Rectangle> logic_part(vector <Rectangle> data, int dsp_w, int dsp_h, int saw_width, int& min_total, double& max_percent)
+//Sorts data by key and places it in place
+void BF(span<Rectangle> data, int dsp_w, int dsp_h, int& total_count, double& percentage, bool rotate, pack_scratch& scratch, sort_key key = key_height)
+{
+	sort_by_key(data, key, scratch);
+	BF_in_order(data, dsp_w, dsp_h, total_count, percentage, rotate, scratch);
+}
+void add_saw_width(span<Rectangle> data, int& dsp_w, int& dsp_h, int saw_width)
 {
-	int total_count = 0;  min_total = 100000000;
-	double percentage = 0; max_percent = 0;
 	//Add saw width to dsp sizes so we dont care about inner and outer rectangles
 	dsp_w += saw_width;
 	dsp_h += saw_width;
@@ -271,129 +593,364 @@ vector <Rectangle> logic_part(vector <Rectangle> data, int dsp_w, int dsp_h, int
 		data[i].width += saw_width;
 		data[i].height += saw_width;
 	}
-	//First try without rotations
-	data = BF(data, dsp_w, dsp_h, total_count, percentage,false);
-	cout << total_count << " " << percentage << endl;
-	vector <Rectangle> best(data); min_total = total_count; max_percent = percentage;
-	//Rotate every Rectangle so height < width
-	//DO bf  and remember stats
-	for (int i = 0; i < data.size(); ++i)
+}
+//One pass of logic_part: how rectangles are oriented and ordered before BF runs
+struct strategy
+{
+	bool landscape = false; //rotate every rectangle so height < width before packing
+	bool rotate = false;    //let BF try both orientations of every rectangle
+	sort_key key = key_height;
+};
+//The four classic passes come first so ties keep resolving to them,
+//extra sort keys only win when they really save material
+const vector <strategy>& default_strategies()
+{
+	static const vector <strategy> strategies = []()
 	{
-		if (data[i].height > data[i].width)
-			swap(data[i].height, data[i].width);
+		vector <strategy> list;
+		for (sort_key key : { key_height, key_area, key_long_side, key_width })
+		{
+			list.push_back({ false, false, key });
+			list.push_back({ true, false, key });
+			list.push_back({ false, true, key });
+			list.push_back({ true, true, key });
+		}
+		return list;
+	}();
+	return strategies;
+}
+//Everything a plan needs between calls: a working copy and scratch buffers per strategy,
+//and the cut trees of the last GUILLOTINE plan. Reusing one context keeps planning allocation free.
+//sheet_bound is the lower bound on the list count of the last planned order.
+//Strategies run on pool, worker_pool::shared() if it is null. Per strategy results go to log if it is set,
+//nothing sets it by default, it is for tracing a plan
+struct pack_context
+{
+	vector <vector <Rectangle>> work;
+	vector <pack_scratch> scratch;
+	vector <int> counts;
+	vector <double> percents;
+	vector <guillotine_sheet> sheets;
+	bounds::bound_scratch bound_scratch;
+	int sheet_bound = 0;
+	size_t winner = 0; //strategy of the last logic_part plan, its levels stay in scratch[winner] until the next plan
+	worker_pool* pool = nullptr;
+	ostream* log = nullptr;
 
-	}
-	data = BF(data, dsp_w, dsp_h, total_count, percentage,false);
-	cout << total_count << " " << percentage << endl;
-	if ((total_count < min_total) || ((total_count == min_total) && (percentage > max_percent)))
+	void reserve(size_t strategies)
 	{
-		best.clear(); best.insert(best.begin(), data.begin(), data.end());
-		min_total = total_count; max_percent = percentage;
+		if (work.size() < strategies)
+		{
+			work.resize(strategies);
+			scratch.resize(strategies);
+			counts.resize(strategies);
+			percents.resize(strategies);
+		}
 	}
-	
-
-
-	//Do bf with rotations
-	data = BF(data, dsp_w, dsp_h, total_count, percentage, true);
-	cout << total_count << " " << percentage << endl;
-	if ((total_count < min_total) || ((total_count == min_total) && (percentage > max_percent)))
+};
+void run_strategy(span<const Rectangle> input, const strategy& s, int dsp_w, int dsp_h, int saw_width, vector <Rectangle>& work, pack_scratch& scratch, int& total_count, double& percentage)
+{
+	work.assign(input.begin(), input.end());
+	add_saw_width(work, dsp_w, dsp_h, saw_width);
+	if (s.landscape)
 	{
-		best.clear(); best.insert(best.begin(), data.begin(), data.end());
-		min_total = total_count; max_percent = percentage;
+		for (auto& r : work)
+		{
+			if (r.height > r.width)
+				r.rotate();
+		}
 	}
-	//Rotate every Rectangle so height < width
-	//DO bf  and remember stats
-	for (int i = 0; i < data.size(); ++i)
+	BF(work, dsp_w, dsp_h, total_count, percentage, s.rotate, scratch, s.key);
+}
+void logic_part(span<const Rectangle> data, int dsp_w, int dsp_h, int saw_width, int& min_total, double& max_percent, vector <Rectangle>& best, pack_context& ctx, const vector <strategy>& strategies = default_strategies())
+{
+	min_total = 100000000;
+	max_percent = 0;
+	best.assign(data.begin(), data.end());
+	ctx.sheet_bound = sheet_lower_bound(data, dsp_w, dsp_h, saw_width, ctx.bound_scratch);
+	if (data.empty() || strategies.empty()) return;
+	//Every strategy packs its own copy of data, pool workers pick the next unclaimed strategy.
+	//The fill only depends on the list count, so once a strategy reaches the lower bound no later one
+	//can win and those are skipped. Earlier ones still run, the winner stays the same as without skipping
+	ctx.reserve(strategies.size());
+	atomic<size_t> first_optimal{ strategies.size() };
+	worker_pool& pool = ctx.pool ? *ctx.pool : worker_pool::shared();
+	pool.run(strategies.size(), [&](size_t s)
 	{
-		if (data[i].height > data[i].width)
-			swap(data[i].height, data[i].width);
+		if (s > first_optimal)
+		{
+			ctx.counts[s] = INT_MAX;
+			return;
+		}
+		run_strategy(data, strategies[s], dsp_w, dsp_h, saw_width, ctx.work[s], ctx.scratch[s], ctx.counts[s], ctx.percents[s]);
+		size_t seen = first_optimal;
+		while ((ctx.counts[s] <= ctx.sheet_bound) && (s < seen) && !first_optimal.compare_exchange_weak(seen, s));
+	});
 
-	}
-	data = BF(data, dsp_w, dsp_h, total_count, percentage, true);
-	cout << total_count << " " << percentage << endl;
-	if ((total_count < min_total) || ((total_count == min_total) && (percentage > max_percent)))
+	//Pick the best plan in strategy order, so the result does not depend on thread timing
+	size_t winner = 0;
+	for (size_t s = 0; s < strategies.size(); ++s)
 	{
-		best.clear(); best.insert(best.begin(), data.begin(), data.end());
-		min_total = total_count; max_percent = percentage;
+		if (ctx.counts[s] == INT_MAX)
+			continue;
+		if (ctx.log)
+			*ctx.log << ctx.counts[s] << " " << ctx.percents[s] << "\n";
+		if ((ctx.counts[s] < min_total) || ((ctx.counts[s] == min_total) && (ctx.percents[s] > max_percent)))
+		{
+			winner = s;
+			min_total = ctx.counts[s]; max_percent = ctx.percents[s];
+		}
 	}
-	
-	return best;
+	ctx.winner = winner;
+	best.assign(ctx.work[winner].begin(), ctx.work[winner].end());
 }
-void algorythm()
+//MaxRects packer: every dsp list keeps its maximal free rectangles, so the space above short parts
+//stays usable instead of being cut off by a shelf. Rectangles go biggest first to the first open list
+//where they fit, there to the free rectangle with the best short side fit, in both orientations unless locked.
+//Output follows BF: y is counted through all lists stacked on top of each other
+void maxrects_part(span<const Rectangle> input, int dsp_w, int dsp_h, int saw_width, int& total_count, double& percentage, vector <Rectangle>& data, pack_scratch& scratch)
 {
-	string in_path = "D:\\1.txt";
-	//generate_some_file(in_path);
-	int dsp_w  = 0 , dsp_h = 0, saw_width = 0;
-	vector <Rectangle> data = read_input(in_path, dsp_w, dsp_h, saw_width);
+	total_count = 0;
+	percentage = 0;
+	data.assign(input.begin(), input.end());
+	if (data.empty()) return;
+	add_saw_width(data, dsp_w, dsp_h, saw_width);
+	sort_by_key(data, key_area, scratch);
+	//smallest side of what is still to be packed, lists that can't hold it are closed
+	vector <int>& min_side = scratch.min_side;
+	min_side.assign(data.size() + 1, INT_MAX);
+	for (int i = data.size() - 1; i >= 0; --i)
+		min_side[i] = min<int>(min_side[i + 1], min(data[i].width, data[i].height));
+
+	vector <maxrects_sheet> sheets;
+	sheet_index open;
 	for (int i = 0; i < data.size(); ++i)
 	{
-		if ((data[i].width > dsp_w) && (data[i].height <= dsp_w))
+		int best_short = INT_MAX, best_long = INT_MAX, best_x = 0, best_y = 0;
+		bool best_rotated = false;
+		int best_sheet = open.find_first(data[i].width, data[i].height, data[i].is_rotatable(), sheets);
+		if (best_sheet != -1)
 		{
-			data[i].rotate();
-			data[i].lock_rotation();
+			for (int turn = 0; turn < 1 + data[i].is_rotatable(); ++turn)
+			{
+				int w = turn ? data[i].height : data[i].width;
+				int h = turn ? data[i].width : data[i].height;
+				int s = 0, l = 0, x = 0, y = 0;
+				if (!sheets[best_sheet].find(w, h, s, l, x, y))
+					continue;
+				if ((s < best_short) || ((s == best_short) && (l < best_long)))
+				{
+					best_short = s; best_long = l;
+					best_x = x; best_y = y;
+					best_rotated = turn;
+				}
+			}
 		}
-		if ((data[i].width > dsp_w) && (data[i].height > dsp_w))
+		else
 		{
-			throw "One of rectangles can't fit in dsp";
+			//If cant fit on any open list start a new one
+			best_sheet = sheets.size();
+			sheets.emplace_back(dsp_w, dsp_h);
+			open.push_back(sheets.back());
 		}
-		if ((data[i].height > dsp_h) && (data[i].width <= dsp_h))
+		if (best_rotated) data[i].rotate();
+		maxrects_sheet& sheet = sheets[best_sheet];
+		sheet.place(best_x, best_y, data[i].width, data[i].height);
+		data[i].x = best_x;
+		data[i].y = best_y + best_sheet * dsp_h;
+		if (sheet.is_closed(min_side[i + 1]))
+			open.close(best_sheet);
+		else
+			open.update(best_sheet, sheet);
+	}
+	total_count = sheets.size();
+	percentage = ((double)total_square(data) / dsp_w) / (dsp_h * total_count);
+}
+//Guillotine packer: every dsp list is a cut tree, so the layout can be made with edge-to-edge
+//saw passes only. Works in real sizes, the saw kerf is the width of every split.
+//Free leaves of all lists sit in one set ordered by area, a rectangle goes to the smallest one
+//it fits and only the leaf it lands on is split. Output follows the other engines
+//(saw width added to sizes, y counted through stacked lists), the cut trees end up in sheets
+//with cut_node::part pointing into data
+void guillotine_part(span<const Rectangle> input, int dsp_w, int dsp_h, int saw_width, int& total_count, double& percentage, vector <Rectangle>& data, vector <guillotine_sheet>& sheets, pack_scratch& scratch)
+{
+	total_count = 0;
+	percentage = 0;
+	sheets.clear();
+	data.assign(input.begin(), input.end());
+	if (data.empty()) return;
+	sort_by_key(data, key_area, scratch);
+	vector <int>& min_side = scratch.min_side;
+	min_side.assign(data.size() + 1, INT_MAX);
+	for (int i = data.size() - 1; i >= 0; --i)
+		min_side[i] = min<int>(min_side[i + 1], min(data[i].width, data[i].height));
+
+	//(area, list, node) of every free leaf
+	set<tuple<long long, int, int>> free_leaves;
+	vector <int> new_free;
+	for (int i = 0; i < data.size(); ++i)
+	{
+		int sheet = -1, node = 0;
+		bool rotated = false;
+		long long area = (long long)data[i].width * data[i].height;
+		for (auto it = free_leaves.lower_bound({ area, -1, -1 }); it != free_leaves.end();)
 		{
-			data[i].rotate();
-			data[i].lock_rotation();
+			const cut_node& leaf = sheets[get<1>(*it)].nodes[get<2>(*it)];
+			if ((leaf.w < min_side[i]) || (leaf.h < min_side[i]))
+			{
+				//nothing that is left can use it anymore
+				it = free_leaves.erase(it);
+				continue;
+			}
+			bool fits = (data[i].width <= leaf.w) && (data[i].height <= leaf.h);
+			bool fits_rotated = data[i].is_rotatable() && (data[i].height <= leaf.w) && (data[i].width <= leaf.h);
+			if (fits || fits_rotated)
+			{
+				sheet = get<1>(*it); node = get<2>(*it);
+				rotated = !fits;
+				free_leaves.erase(it);
+				break;
+			}
+			++it;
 		}
-		if ((data[i].height > dsp_h) && (data[i].width <= dsp_h))
+		if (sheet == -1)
 		{
-			throw "One of rectangles can't fit in dsp";
+			//If cant fit anywhere start a new list
+			sheet = sheets.size();
+			sheets.emplace_back(dsp_w, dsp_h, saw_width);
 		}
+		if (rotated) data[i].rotate();
+		new_free.clear();
+		sheets[sheet].place(node, data[i].width, data[i].height, i, new_free);
+		data[i].x = sheets[sheet].nodes[node].x;
+		data[i].y = sheets[sheet].nodes[node].y;
+		data[i].dspN = sheet;
+		for (int f : new_free)
+		{
+			const cut_node& leaf = sheets[sheet].nodes[f];
+			free_leaves.insert({ (long long)leaf.w * leaf.h, sheet, f });
+		}
+	}
+	//Same frame as logic_part from here on
+	add_saw_width(data, dsp_w, dsp_h, saw_width);
+	for (auto& r : data)
+		r.y += r.dspN * dsp_h;
+	total_count = sheets.size();
+	percentage = ((double)total_square(data) / dsp_w) / (dsp_h * total_count);
+}
+//Runs the chosen engine, ctx.sheets gets the cut trees when the engine is GUILLOTINE
+void pack(span<const Rectangle> data, int dsp_w, int dsp_h, int saw_width, PackEngine engine, int& min_total, double& max_percent, vector <Rectangle>& best, pack_context& ctx)
+{
+	ctx.reserve(1);
+	//logic_part works the bound out itself, it needs it to stop early
+	if (engine != SHELF)
+		ctx.sheet_bound = sheet_lower_bound(data, dsp_w, dsp_h, saw_width, ctx.bound_scratch);
+	switch (engine)
+	{
+	case MAXRECTS:
+		maxrects_part(data, dsp_w, dsp_h, saw_width, min_total, max_percent, best, ctx.scratch[0]);
+		break;
+	case GUILLOTINE:
+		guillotine_part(data, dsp_w, dsp_h, saw_width, min_total, max_percent, best, ctx.sheets, ctx.scratch[0]);
+		break;
+	default:
+		logic_part(data, dsp_w, dsp_h, saw_width, min_total, max_percent, best, ctx);
+		break;
+	}
+}
+//Turns and locks a rectangle that fits a dsp list only one way, or has to follow the grain.
+//Throws if it fits no way
+void fit_part_to_dsp(Rectangle& r, int dsp_w, int dsp_h)
+{
+	if (r.grain != GRAIN_NONE)
+	{
+		if ((r.grain == GRAIN_ALONG_HEIGHT) || ((r.grain == GRAIN_ALONG_LENGTH) && (r.height > r.width)))
+			r.rotate();
+		r.grain = GRAIN_ALONG_WIDTH;
+		r.lock_rotation();
+		if ((r.width > dsp_w) || (r.height > dsp_h))
+			throw "One of rectangles can't fit in dsp along the grain";
+		return;
+	}
+	if ((r.width > dsp_w) && (r.height <= dsp_w))
+	{
+		r.rotate();
+		r.lock_rotation();
+	}
+	if ((r.width > dsp_w) && (r.height > dsp_w))
+	{
+		throw "One of rectangles can't fit in dsp";
+	}
+	if ((r.height > dsp_h) && (r.width <= dsp_h))
+	{
+		r.rotate();
+		r.lock_rotation();
+	}
+	if (r.height > dsp_h)
+	{
+		throw "One of rectangles can't fit in dsp";
+	}
+}
+void fit_to_dsp(vector <Rectangle>& data, int dsp_w, int dsp_h)
+{
+	for (int i = 0; i < data.size(); ++i)
+		fit_part_to_dsp(data[i], dsp_w, dsp_h);
+}
+//Edge banders mill a little off every banded edge before the band is glued on, so a part is cut
+//allowance bigger on each canted side. Goes before fit_to_dsp
+void add_band_allowance(span<Rectangle> data, int allowance)
+{
+	for (auto& r : data)
+	{
+		r.width += allowance * (r.east_canted + r.west_canted);
+		r.height += allowance * (r.north_canted + r.south_canted);
 	}
+}
+//Moves a plan from the stacked frame of the packers into separate lists: dspN is set and y is
+//counted inside the list. Lists are stacked with the saw width added to their height, see add_saw_width.
+//Returns the number of lists
+unsigned int split_lists(span<Rectangle> plan, int dsp_h, int saw_width)
+{
+    unsigned int list_h = dsp_h + saw_width;
+    unsigned int dspNmax = 0;
+    for (auto &rect : plan)
+    {
+        rect.dspN = (rect.y / list_h);
+        if (rect.dspN > dspNmax) dspNmax = rect.dspN;
+        rect.y = rect.y - rect.dspN * list_h;
+    }
+    return dspNmax + 1;
+}
+void algorythm(string in_path = "D:\\1.txt")
+{
+	//generate_some_file(in_path);
+	int dsp_w  = 0 , dsp_h = 0, saw_width = 0;
+	vector <Rectangle> data = read_input(in_path, dsp_w, dsp_h, saw_width);
+	fit_to_dsp(data, dsp_w, dsp_h);
 	int min_total = 0; double max_percent = 0;
+	vector <Rectangle> best;
+	pack_context ctx;
 		auto start = chrono::steady_clock::now();
-	vector <Rectangle> best = logic_part(data, dsp_w, dsp_h, saw_width, min_total, max_percent);
+	logic_part(data, dsp_w, dsp_h, saw_width, min_total, max_percent, best, ctx);
 		cout << min_total << " " << max_percent << endl;
 		auto finish = chrono::steady_clock::now();
 		cout << "Time : " << chrono::duration_cast <chrono::milliseconds>(finish - start).count()  << "ms "<< endl;
-	write_output(best, min_total, max_percent, dsp_h);
+	write_output(best, min_total, max_percent, ctx.sheet_bound);
 }
-std::pair<vector <Rectangle>, unsigned int> algorythm(vector<vector<int>> input, int dsp_w, int dsp_h, int saw_width = 10)
+std::pair<vector <Rectangle>, unsigned int> algorythm(const vector<vector<int>>& input, int dsp_w, int dsp_h, int saw_width = 10, PackEngine engine = SHELF)
 {
 	vector <Rectangle> data = cast_input_vector(input);
-	for (int i = 0; i < data.size(); ++i)
-	{
-		if ((data[i].width > dsp_w) && (data[i].height <= dsp_w))
-		{
-			data[i].rotate();
-			data[i].lock_rotation();
-		}
-		if ((data[i].width > dsp_w) && (data[i].height > dsp_w))
-		{
-			throw "One of rectangles can't fit in dsp";
-		}
-		if ((data[i].height > dsp_h) && (data[i].width <= dsp_h))
-		{
-			data[i].rotate();
-			data[i].lock_rotation();
-		}
-		if ((data[i].height > dsp_h) && (data[i].width <= dsp_h))
-		{
-			throw "One of rectangles can't fit in dsp";
-		}
-	}
+	fit_to_dsp(data, dsp_w, dsp_h);
 	int min_total = 0; double max_percent = 0;
 	auto start = chrono::steady_clock::now();
-	vector <Rectangle> best = logic_part(data, dsp_w, dsp_h, saw_width, min_total, max_percent);
+	vector <Rectangle> best;
+	pack_context ctx;
+	pack(data, dsp_w, dsp_h, saw_width, engine, min_total, max_percent, best, ctx);
 	cout << min_total << " " << max_percent << endl;
 	auto finish = chrono::steady_clock::now();
 	cout << "Time : " << chrono::duration_cast<chrono::milliseconds>(finish - start).count() << "ms " << endl;
-    unsigned int dspNmax = 0;
-    for (auto &rect : best)
-    {
-        rect.dspN = (rect.y / dsp_h);
-        if (rect.dspN > dspNmax) dspNmax = rect.dspN;
-        if (rect.dspN > 0)
-        {
-            rect.y = rect.y - rect.dspN * dsp_h;
-        }
-    }
-	write_output(best, min_total, max_percent, dsp_h);
-    return {best, dspNmax + 1};
+	unsigned int lists = split_lists(best, dsp_h, saw_width);
+	write_output(best, min_total, max_percent, ctx.sheet_bound);
+	write_cuts(ctx.sheets);
+    return {best, lists};
 }
\ No newline at end of file
@@ -0,0 +1,154 @@
+#pragma once
+#include "Algorythm.h"
+#include "RemnantStore.h"
+#include <functional>
+#include <mutex>
+
+//One order of a batch, parts in real sizes. With stock set the order is cut from that inventory
+//by stock_part, whatever engine the batch runs, and dsp_w, dsp_h are not used
+struct batch_order
+{
+	string name;
+	int dsp_w = 0;
+	int dsp_h = 0;
+	int saw_width = 0;
+	vector <Rectangle> parts;
+	vector <stock_sheet> stock;
+	//with keep_leftovers the usable leftovers of the plan are listed in batch_plan::leftovers
+	bool keep_leftovers = false;
+	int min_short = 0;
+	int min_long = 0;
+};
+
+//Plan of one order in algorythm() form: saw width added to sizes, dspN set and y counted inside the list.
+//If the order could not be read or packed only name and error are set
+struct batch_plan
+{
+	size_t index = 0;
+	string name;
+	int dsp_w = 0;
+	int dsp_h = 0;
+	int saw_width = 0;
+	int total_count = 0;
+	double percentage = 0;
+	int sheet_bound = 0;
+	double ms = 0;
+	vector <Rectangle> parts;
+	double cost = 0; //of the stock used, 0 without stock
+	vector <int> sheet_stock; //stock entry every sheet is cut from, empty without stock
+	vector <leftover> leftovers;
+	string error;
+};
+
+typedef function<void(size_t, batch_order&)> order_loader;
+typedef function<void(const batch_plan&)> plan_writer;
+
+//Packs count orders, one order per task on pool. Idle workers take the next unclaimed order, so a
+//thread stuck on a big order never holds up the rest. Orders are independent and known up front, so one
+//shared counter balances them as well as work stealing would, without per-thread queues to steal from. Every order runs its strategies on the thread
+//that took it, with a context that thread keeps, so warm plans don't allocate.
+//load fills order i in on a worker thread, so reading files runs in parallel too.
+//write gets the plans in order index order, one at a time. It runs without the lock held, on the worker
+//that finished the next plan in line, which also writes the plans ready after it while the rest keep packing
+void pack_batch(size_t count, const order_loader& load, PackEngine engine, const plan_writer& write, worker_pool& pool = worker_pool::shared())
+{
+	mutex m;
+	size_t next = 0;
+	bool writing = false;
+	vector <batch_plan> pending(count);
+	vector <char> finished(count, 0);
+	pool.run(count, [&](size_t i)
+	{
+		thread_local worker_pool serial(1);
+		thread_local pack_context ctx;
+		thread_local batch_order order;
+		ctx.pool = &serial;
+
+		batch_plan plan;
+		plan.index = i;
+		try
+		{
+			order.name.clear();
+			order.parts.clear();
+			order.stock.clear();
+			order.keep_leftovers = false;
+			load(i, order);
+			plan.name = order.name;
+			plan.dsp_w = order.dsp_w; plan.dsp_h = order.dsp_h; plan.saw_width = order.saw_width;
+			auto start = chrono::steady_clock::now();
+			if (order.stock.empty())
+			{
+				fit_to_dsp(order.parts, order.dsp_w, order.dsp_h);
+				pack(order.parts, order.dsp_w, order.dsp_h, order.saw_width, engine, plan.total_count, plan.percentage, plan.parts, ctx);
+				split_lists(plan.parts, order.dsp_h, order.saw_width);
+				plan.sheet_bound = ctx.sheet_bound;
+			}
+			else
+			{
+				//no sheet is too small for a part yet, so this only turns grain along the width and locks it
+				for (auto& r : order.parts)
+					fit_part_to_dsp(r, INT_MAX, INT_MAX);
+				ctx.reserve(1);
+				stock_part(order.parts, order.stock, order.saw_width, plan.cost, plan.parts, ctx.sheets, plan.sheet_stock, ctx.scratch[0]);
+				plan.total_count = plan.sheet_stock.size();
+				long long used = 0, total = 0;
+				for (auto& r : plan.parts)
+					used += (long long)(r.width - order.saw_width) * (r.height - order.saw_width);
+				for (int k : plan.sheet_stock)
+					total += (long long)order.stock[k].width * order.stock[k].height;
+				plan.percentage = total ? (double)used / total : 0;
+			}
+			if (order.keep_leftovers)
+			{
+				if (order.stock.empty())
+					plan_leftovers(ctx, engine, order.dsp_w, order.dsp_h, order.saw_width, order.min_short, order.min_long, plan.leftovers);
+				else
+					cut_leftovers(ctx.sheets, order.min_short, order.min_long, plan.leftovers);
+			}
+			plan.ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+		}
+		catch (const char* e)
+		{
+			plan.error = e;
+		}
+		catch (const exception& e)
+		{
+			plan.error = e.what();
+		}
+		if (!plan.error.empty())
+		{
+			plan.name = order.name;
+			plan.parts.clear();
+			plan.leftovers.clear();
+		}
+
+		unique_lock<mutex> lock(m);
+		pending[i] = move(plan);
+		finished[i] = 1;
+		if (writing)
+			return;
+		writing = true;
+		vector <batch_plan> ready;
+		while ((next < count) && finished[next])
+		{
+			for (; (next < count) && finished[next]; ++next)
+				ready.push_back(move(pending[next]));
+			lock.unlock();
+			try
+			{
+				for (auto& p : ready)
+					write(p);
+			}
+			catch (...)
+			{
+				//the batch stops with this exception, the next writer must not wait for us
+				lock.lock();
+				writing = false;
+				throw;
+			}
+			ready.clear();
+			lock.lock();
+		}
+		writing = false;
+	});
+}
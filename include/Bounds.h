@@ -0,0 +1,170 @@
+#pragma once
+#include <vector>
+#include <span>
+#include <algorithm>
+
+//Lower bounds on the number of dsp lists any plan needs. Sizes are taken with the saw width
+//added, like the packers see them. A part that may turn is counted by what holds in both of its
+//turns, so the bounds stay valid whatever orientation a plan picks
+namespace bounds
+{
+	//Smallest width and height over the turns a part may take. Every condition the bounds test
+	//is "at least this wide and this high", which holds in every turn iff it holds for these
+	struct part_size
+	{
+		int min_w;
+		int min_h;
+		long long area;
+	};
+
+	//Buffers of one bound computation, kept between orders so it doesn't allocate once warm
+	struct bound_scratch
+	{
+		std::vector<part_size> parts;
+		std::vector<int> ps, qs;
+		std::vector<long long> count1, area1, area3;
+	};
+
+	template <class Part>
+	void sizes(std::span<const Part> data, int list_w, int list_h, int saw_width, std::vector<part_size>& parts)
+	{
+		parts.clear();
+		for (auto& r : data)
+		{
+			int w = r.width + saw_width, h = r.height + saw_width;
+			bool turns = r.is_rotatable() && (h <= list_w) && (w <= list_h);
+			parts.push_back({ turns ? std::min(w, h) : w, turns ? std::min(w, h) : h, (long long)w * h });
+		}
+	}
+
+	//L1: the area of the parts over the area of a list
+	inline int area_bound(const std::vector<part_size>& parts, int list_w, int list_h)
+	{
+		long long total = 0;
+		for (auto& p : parts)
+			total += p.area;
+		long long list = (long long)list_w * list_h;
+		return (total + list - 1) / list;
+	}
+
+	//Parts wider than half a list never stand side by side, so their heights add up on a list.
+	//Same for parts higher than half a list and their widths
+	inline int strip_bound(const std::vector<part_size>& parts, int list_w, int list_h)
+	{
+		long long wide = 0, high = 0;
+		for (auto& p : parts)
+		{
+			if (2 * p.min_w > list_w) wide += p.min_h;
+			if (2 * p.min_h > list_h) high += p.min_w;
+		}
+		return (int)std::max((wide + list_h - 1) / list_h, (high + list_w - 1) / list_w);
+	}
+
+	//Leaves up to limit values spread over the sorted distinct values, 1 is always a candidate
+	inline void candidates(std::vector<int>& values, size_t limit)
+	{
+		values.push_back(1);
+		std::sort(values.begin(), values.end());
+		values.erase(std::unique(values.begin(), values.end()), values.end());
+		if (values.size() <= limit)
+			return;
+		size_t n = values.size();
+		for (size_t i = 0; i < limit; ++i)
+			values[i] = values[i * (n - 1) / (limit - 1)];
+		values.resize(limit);
+	}
+
+	//Martello-Vigo L2, best over a grid of (p, q) taken from the part sizes, q <= list_w / 2, p <= list_h / 2.
+	//Large parts, over half a list both ways, each need their own list. I1 are the large parts over
+	//list_w - q wide and list_h - p high, nothing at least q x p fits next to them. I3 are the other
+	//parts at least q x p, they only fit on the lists of the large parts outside I1 or on new ones.
+	//Parts are binned once into the grid and summed up over it, so every point costs O(1)
+	inline int grid_mv_bound(const std::vector<part_size>& parts, int list_w, int list_h, bound_scratch& scratch, size_t limit = 64)
+	{
+		std::vector<int>& ps = scratch.ps;
+		std::vector<int>& qs = scratch.qs;
+		ps.clear(); qs.clear();
+		for (auto& s : parts)
+		{
+			if (2 * s.min_h <= list_h) ps.push_back(s.min_h);
+			if (2 * s.min_w <= list_w) qs.push_back(s.min_w);
+		}
+		candidates(ps, limit);
+		candidates(qs, limit);
+		int kp = ps.size(), kq = qs.size();
+		//count1/area1[a][b]: I1 at (ps[a], qs[b]) once summed from (0, 0), area3 once summed from the far corner
+		std::vector<long long>& count1 = scratch.count1;
+		std::vector<long long>& area1 = scratch.area1;
+		std::vector<long long>& area3 = scratch.area3;
+		count1.assign(kp * kq, 0); area1.assign(kp * kq, 0); area3.assign(kp * kq, 0);
+		long long large = 0, large_area = 0;
+		for (auto& s : parts)
+		{
+			if ((2 * s.min_w > list_w) && (2 * s.min_h > list_h))
+			{
+				large++;
+				large_area += s.area;
+				int a = std::upper_bound(ps.begin(), ps.end(), list_h - s.min_h) - ps.begin();
+				int b = std::upper_bound(qs.begin(), qs.end(), list_w - s.min_w) - qs.begin();
+				if ((a < kp) && (b < kq))
+				{
+					count1[a * kq + b]++;
+					area1[a * kq + b] += s.area;
+				}
+			}
+			else
+			{
+				int a = std::upper_bound(ps.begin(), ps.end(), s.min_h) - ps.begin() - 1;
+				int b = std::upper_bound(qs.begin(), qs.end(), s.min_w) - qs.begin() - 1;
+				if ((a >= 0) && (b >= 0))
+					area3[a * kq + b] += s.area;
+			}
+		}
+		for (int a = 0; a < kp; ++a)
+		{
+			for (int b = 0; b < kq; ++b)
+			{
+				int i = a * kq + b;
+				if (a > 0) { count1[i] += count1[i - kq]; area1[i] += area1[i - kq]; }
+				if (b > 0) { count1[i] += count1[i - 1]; area1[i] += area1[i - 1]; }
+				if ((a > 0) && (b > 0)) { count1[i] -= count1[i - kq - 1]; area1[i] -= area1[i - kq - 1]; }
+			}
+		}
+		for (int a = kp - 1; a >= 0; --a)
+		{
+			for (int b = kq - 1; b >= 0; --b)
+			{
+				int i = a * kq + b;
+				if (a + 1 < kp) area3[i] += area3[i + kq];
+				if (b + 1 < kq) area3[i] += area3[i + 1];
+				if ((a + 1 < kp) && (b + 1 < kq)) area3[i] -= area3[i + kq + 1];
+			}
+		}
+		long long list = (long long)list_w * list_h;
+		long long best = large;
+		for (int i = 0; i < kp * kq; ++i)
+		{
+			long long room = (large - count1[i]) * list - (large_area - area1[i]);
+			long long rest = area3[i] - room;
+			best = std::max(best, large + (rest > 0 ? (rest + list - 1) / list : 0));
+		}
+		return best;
+	}
+}
+
+//Fewest dsp lists any plan of data can use: the best of L1, the strip bounds and L2
+template <class Part>
+int sheet_lower_bound(std::span<const Part> data, int dsp_w, int dsp_h, int saw_width, bounds::bound_scratch& scratch)
+{
+	if (data.empty())
+		return 0;
+	int list_w = dsp_w + saw_width, list_h = dsp_h + saw_width;
+	bounds::sizes(data, list_w, list_h, saw_width, scratch.parts);
+	return std::max({ bounds::area_bound(scratch.parts, list_w, list_h), bounds::strip_bound(scratch.parts, list_w, list_h), bounds::grid_mv_bound(scratch.parts, list_w, list_h, scratch) });
+}
+template <class Part>
+int sheet_lower_bound(std::span<const Part> data, int dsp_w, int dsp_h, int saw_width)
+{
+	bounds::bound_scratch scratch;
+	return sheet_lower_bound(data, dsp_w, dsp_h, saw_width, scratch);
+}
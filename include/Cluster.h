@@ -5,11 +5,21 @@
 #include <stack>
 #include <vector>
 #include <tuple>
+#include <algorithm>
+#include <cstdint>
+#include <climits>
 #include <iostream>
+#include <unordered_map>
 #include <glm/vec2.hpp>
 #include <glm/vec3.hpp>
 #include "Tools.hpp"
+#include "Persistent.h"
 
+//Clusters are kept by their place in a ClusterPool, ids stay the same until ClusterManager::compact()
+typedef uint32_t ClusterId;
+const ClusterId NO_CLUSTER = UINT32_MAX;
+
+class ClusterIO;
 
 class Cluster
 {
@@ -17,107 +27,649 @@ private:
     glm::ivec2 lower;
     glm::ivec2 upper;
 
-    Cluster *firstChild;
-    Cluster *secondChild;
-    Cluster *parent;
+    //the two children are always next to each other, the second one is children + 1
+    ClusterId children;
+    ClusterId parent;
+    //given once when the cluster is made and never again, ids are reused but serials aren't
+    uint32_t serial;
+    //false while the node waits in the pool's free list
+    bool alive;
 
 public:
-    IObject* linked_object;
-    bool isRoot()
+    bool isRoot() const
+    {
+        return parent == NO_CLUSTER;
+    }
+
+    bool isLeaf() const
+    {
+        return children == NO_CLUSTER;
+    }
+
+    bool isAlive() const
+    {
+        return alive;
+    }
+
+    ClusterId getParent() const
+    {
+        return parent;
+    }
+
+    //first of the two children, the second is the next id. NO_CLUSTER for a leaf
+    ClusterId getChildren() const
     {
-        return parent == nullptr;
+        return children;
     }
 
-    bool isLeaf()
+    glm::ivec2 getLower() const
     {
-        return firstChild == nullptr;
+        return lower;
     }
 
-    bool isVertical()
+    glm::ivec2 getUpper() const
     {
-        return firstChild->lower.y == secondChild->lower.y;
+        return upper;
     }
 
-    Cluster(glm::ivec2 lower, glm::ivec2 upper, Cluster *parent = nullptr)
+    Cluster(glm::ivec2 lower, glm::ivec2 upper, ClusterId parent = NO_CLUSTER)
     {
-        firstChild = nullptr;
-        secondChild = nullptr;
+        children = NO_CLUSTER;
         this->parent = parent;
         this->lower = lower;
         this->upper = upper;
+        serial = 0;
+        alive = true;
     }
 
-    void split(glm::ivec2 separator_pos, int separator_width, bool isVertical)
+    friend class ClusterManager;
+    friend class ClusterPool;
+    friend class ClusterIO;
+};
+
+//Cluster nodes in one persistent array. Children are made in pairs, released pairs are reused before
+//the array grows, so splitting and merging compartments over and over neither allocates nor leaks
+class ClusterPool
+{
+private:
+    PersistentArray<Cluster> nodes;
+    PersistentStack<ClusterId> freePairs;
+
+public:
+    const Cluster &operator[](ClusterId id) const
     {
-        if (isVertical)
-        {
-            firstChild = new Cluster(lower, glm::ivec2(separator_pos.x , upper.y), this);
-            secondChild = new Cluster(glm::ivec2(separator_pos.x + separator_width, lower.y), upper, this);
-        }
-        else
-        {
-            firstChild = new Cluster(lower, glm::ivec2(upper.x, separator_pos.y ), this);
-            secondChild = new Cluster(glm::ivec2(lower.x, separator_pos.y + separator_width), upper, this);
-        }
+        return nodes[id];
     }
 
-    Cluster *toLocalCluster(glm::ivec2 pos)
+    //Writable node, valid until the pool is copied or changed again
+    Cluster &mut(ClusterId id)
     {
-        if (isLeaf())
+        return nodes.mut(id);
+    }
+
+    ClusterId createRoot(glm::ivec2 lower, glm::ivec2 upper)
+    {
+        nodes.clear();
+        freePairs.clear();
+        nodes.push_back(Cluster(lower, upper));
+        return 0;
+    }
+
+    //Stores two children next to each other and returns the id of the first
+    ClusterId createPair(const Cluster &first, const Cluster &second)
+    {
+        if (freePairs.empty())
         {
-            return this;
+            nodes.push_back(first);
+            nodes.push_back(second);
+            return nodes.size() - 2;
         }
+        ClusterId id = freePairs.top();
+        freePairs.pop();
+        nodes.mut(id) = first;
+        nodes.mut(id + 1) = second;
+        return id;
+    }
+
+    //The nodes stay readable until the next createPair()
+    void releasePair(ClusterId id)
+    {
+        nodes.mut(id).alive = false;
+        nodes.mut(id + 1).alive = false;
+        freePairs.push(id);
+    }
+
+    size_t size() const
+    {
+        return nodes.size() - 2 * freePairs.size();
+    }
+
+    size_t capacity() const
+    {
+        return nodes.size();
+    }
+
+    //Calls f(id) for every id that may have been written since other was copied from this pool or
+    //the other way round, free ones too
+    template <class F>
+    void changed(const ClusterPool &other, F f) const
+    {
+        nodes.diff(other.nodes, f);
+    }
+};
 
-        int target = !isVertical();
+//Clusters by (axis, coordinate) of one of their edges, so a separator gets the clusters it moves
+//without looking at all of them. A hash table with its buckets in a PersistentArray, copies share
+//every bucket that wasn't changed since
+class EdgeIndex
+{
+private:
+    struct Edge
+    {
+        int axis;
+        int coordinate;
+        std::vector<ClusterId> ids;
+    };
+    typedef std::vector<Edge> Bucket;
+
+    PersistentArray<std::shared_ptr<Bucket>> buckets;
+    size_t edges = 0;
+
+    size_t slot(int axis, int coordinate) const
+    {
+        uint64_t h = (uint64_t)(uint32_t)coordinate * 0x9e3779b97f4a7c15ULL + axis;
+        return (h ^ (h >> 29)) & (buckets.size() - 1);
+    }
 
-        if (pos[target] < firstChild->upper[target])
+    //Bucket this copy may change, copied first if another copy still has it
+    Bucket &own(size_t k)
+    {
+        std::shared_ptr<Bucket> &bucket = buckets.mut(k);
+        if (!bucket)
+            bucket = std::make_shared<Bucket>();
+        else if (bucket.use_count() > 1)
+            bucket = std::make_shared<Bucket>(*bucket);
+        return *bucket;
+    }
+
+    void reset(size_t size)
+    {
+        buckets.clear();
+        for (size_t k = 0; k < size; ++k)
+            buckets.push_back(nullptr);
+        edges = 0;
+    }
+
+    std::vector<Edge> all() const
+    {
+        std::vector<Edge> result;
+        for (size_t k = 0; k < buckets.size(); ++k)
+            if (buckets[k])
+                result.insert(result.end(), buckets[k]->begin(), buckets[k]->end());
+        return result;
+    }
+
+    Edge &ownEdge(int axis, int coordinate)
+    {
+        if (edges >= 2 * buckets.size())
         {
-            return firstChild->toLocalCluster(pos);
+            std::vector<Edge> old = all();
+            reset(buckets.size() * 2);
+            for (Edge &e : old)
+                own(slot(e.axis, e.coordinate)).push_back(std::move(e));
+            edges = old.size();
         }
+        Bucket &bucket = own(slot(axis, coordinate));
+        for (Edge &e : bucket)
+            if (e.axis == axis && e.coordinate == coordinate)
+                return e;
+        edges++;
+        bucket.push_back({axis, coordinate, {}});
+        return bucket.back();
+    }
+
+public:
+    EdgeIndex()
+    {
+        reset(64);
+    }
+
+    const std::vector<ClusterId> *find(int axis, int coordinate) const
+    {
+        const std::shared_ptr<Bucket> &bucket = buckets[slot(axis, coordinate)];
+        if (bucket)
+            for (const Edge &e : *bucket)
+                if (e.axis == axis && e.coordinate == coordinate)
+                    return &e.ids;
+        return nullptr;
+    }
+
+    void add(int axis, int coordinate, ClusterId id)
+    {
+        ownEdge(axis, coordinate).ids.push_back(id);
+    }
 
-        if (pos[target] > secondChild->lower[target])
+    //Drops the clusters dead() says are gone from an edge
+    template <class Dead>
+    void sweep(int axis, int coordinate, Dead dead)
+    {
+        if (!find(axis, coordinate))
+            return;
+        Bucket &bucket = own(slot(axis, coordinate));
+        for (size_t i = 0; i < bucket.size(); ++i)
         {
-            return secondChild->toLocalCluster(pos);
+            if (bucket[i].axis != axis || bucket[i].coordinate != coordinate)
+                continue;
+            std::vector<ClusterId> &ids = bucket[i].ids;
+            ids.erase(std::remove_if(ids.begin(), ids.end(), dead), ids.end());
+            if (ids.empty())
+            {
+                bucket.erase(bucket.begin() + i);
+                edges--;
+            }
+            return;
         }
+    }
 
-        return nullptr;
+    //Takes an edge out of the index and returns its clusters
+    std::vector<ClusterId> take(int axis, int coordinate)
+    {
+        if (!find(axis, coordinate))
+            return {};
+        Bucket &bucket = own(slot(axis, coordinate));
+        auto it = std::find_if(bucket.begin(), bucket.end(), [&](const Edge &e) { return e.axis == axis && e.coordinate == coordinate; });
+        std::vector<ClusterId> ids = std::move(it->ids);
+        bucket.erase(it);
+        edges--;
+        return ids;
     }
 
-    ~Cluster(){
+    void add(int axis, int coordinate, const std::vector<ClusterId> &ids)
+    {
+        if (ids.empty())
+            return;
+        std::vector<ClusterId> &edge = ownEdge(axis, coordinate).ids;
+        edge.insert(edge.end(), ids.begin(), ids.end());
+    }
 
-    };
+    //Every cluster on an edge moves with it, so the whole entry goes over to the new coordinate
+    void move(int axis, int from, int to)
+    {
+        if (from != to)
+            add(axis, to, take(axis, from));
+    }
 
-    friend class ClusterManager;
+    //Gives every cluster the id newId has for it
+    void remap(const std::vector<ClusterId> &newId)
+    {
+        std::vector<Edge> old = all();
+        reset(buckets.size());
+        for (Edge &e : old)
+        {
+            for (ClusterId &id : e.ids)
+                id = newId[id];
+            own(slot(e.axis, e.coordinate)).push_back(std::move(e));
+        }
+        edges = old.size();
+    }
+};
+
+//One version of a design. Copying one is cheap and the copies share everything, an edit
+//on a copy only adds the nodes and buckets it changes
+struct ClusterState
+{
+    ClusterPool pool;
+    EdgeIndex lowerEdges;
+    EdgeIndex upperEdges;
+    ClusterId root = NO_CLUSTER;
+};
+
+//Where a batch edit puts the separator of a cluster: the new coordinate of its near side, the upper
+//edge of the first child. The separator keeps its thickness
+struct SeparatorTarget
+{
+    ClusterId cluster;
+    int position;
 };
 
 class ClusterManager
 {
 private:
-    Cluster *root;
-    std::vector<Cluster *> clusters;
+    //A line of cluster edges going to a new coordinate, upper tells the index it is in
+    struct EdgeMove
+    {
+        bool upper;
+        int axis;
+        int from;
+        int to;
+
+        bool operator<(const EdgeMove &other) const
+        {
+            return std::tie(upper, axis, from, to) < std::tie(other.upper, other.axis, other.from, other.to);
+        }
+
+        bool operator==(const EdgeMove &other) const
+        {
+            return std::tie(upper, axis, from, to) == std::tie(other.upper, other.axis, other.from, other.to);
+        }
+    };
+
+    //A cluster as point location needs it: which way it is split and the near and far side of the
+    //separator. children is the place of the first child in the flat array, NO_CLUSTER for a leaf
+    struct FlatNode
+    {
+        int axis;
+        int nearSide;
+        int farSide;
+        uint32_t children;
+        ClusterId id;
+    };
+
+    ClusterState state;
+    //versions before the current one, the last is the newest, and the ones undo stepped back from
+    std::vector<ClusterState> undoStack;
+    std::vector<ClusterState> redoStack;
+    //scene object of every cluster serial. The objects belong to the scene, not to a version
+    std::unordered_map<uint32_t, IObject *> links;
+    //serial of the next cluster made, the root has 0. Outside the versions, so undo never gives one out twice
+    uint32_t nextSerial = 1;
     glm::vec3 origin;
     int depth;
+    //The current version breadth first in one array, made on the first toLocalCluster() after an edit.
+    //Reads go through the pool's trie, this keeps a descent on plain memory. Empty while out of date
+    mutable std::vector<FlatNode> flat;
+
+    //Runs edit on the current version. If it changed anything the version before is kept for undo,
+    //else the current version is put back as it was
+    template <class Edit>
+    bool record(Edit edit)
+    {
+        ClusterState before = state;
+        if (!edit())
+        {
+            state = std::move(before);
+            return false;
+        }
+        undoStack.push_back(std::move(before));
+        redoStack.clear();
+        flat.clear();
+        return true;
+    }
+
+    void buildFlat() const
+    {
+        flat.push_back({0, 0, 0, NO_CLUSTER, state.root});
+        for (size_t i = 0; i < flat.size(); ++i)
+        {
+            ClusterId children = state.pool[flat[i].id].children;
+            if (children == NO_CLUSTER)
+                continue;
+            const Cluster &first = state.pool[children];
+            const Cluster &second = state.pool[children + 1];
+            int target = first.lower.y != second.lower.y;
+            flat[i] = {target, first.upper[target], second.lower[target], (uint32_t)flat.size(), flat[i].id};
+            flat.push_back({0, 0, 0, NO_CLUSTER, children});
+            flat.push_back({0, 0, 0, NO_CLUSTER, children + 1});
+        }
+    }
+
+    //toLocalCluster() on the pool itself, for edits that change the tree right after
+    ClusterId findLeaf(glm::ivec2 pos) const
+    {
+        ClusterId id = state.root;
+        ClusterId children = state.pool[id].children;
+        while (children != NO_CLUSTER)
+        {
+            const Cluster &first = state.pool[children];
+            const Cluster &second = state.pool[children + 1];
+            int target = first.lower.y != second.lower.y;
+            if (pos[target] < first.upper[target])
+            {
+                id = children;
+                children = first.children;
+            }
+            else if (pos[target] > second.lower[target])
+            {
+                id = children + 1;
+                children = second.children;
+            }
+            else
+                return NO_CLUSTER;
+        }
+        return id;
+    }
+
+    void addEdges(ClusterId id)
+    {
+        const Cluster &c = state.pool[id];
+        for (int axis = 0; axis < 2; ++axis)
+        {
+            state.lowerEdges.add(axis, c.lower[axis], id);
+            state.upperEdges.add(axis, c.upper[axis], id);
+        }
+    }
+
+    //Drops clusters that are no longer alive from the edges they were on. Many of them can share
+    //an edge, so every edge they touch is swept once
+    void removeDeadEdges(const std::vector<ClusterId> &dead)
+    {
+        std::vector<std::tuple<int, int, int>> touched;
+        for (ClusterId id : dead)
+        {
+            const Cluster &c = state.pool[id];
+            for (int axis = 0; axis < 2; ++axis)
+            {
+                touched.push_back({0, axis, c.lower[axis]});
+                touched.push_back({1, axis, c.upper[axis]});
+            }
+        }
+        std::sort(touched.begin(), touched.end());
+        touched.erase(std::unique(touched.begin(), touched.end()), touched.end());
+        auto gone = [&](ClusterId id) { return !state.pool[id].alive; };
+        for (auto &[side, axis, coordinate] : touched)
+            (side == 0 ? state.lowerEdges : state.upperEdges).sweep(axis, coordinate, gone);
+    }
+
+    //Moves every line in moves at once. Only clusters on a moving line can change size, each is checked
+    //once against where both its edges end up, so lines may push each other as long as no cluster gets
+    //smaller than minSize (or smaller than it was, if it is below that already). False and no change if
+    //one does or two moves want the same line in different places
+    bool moveEdges(std::vector<EdgeMove> moves, int minSize)
+    {
+        std::sort(moves.begin(), moves.end());
+        moves.erase(std::unique(moves.begin(), moves.end()), moves.end());
+        for (size_t i = 1; i < moves.size(); ++i)
+            if (std::tie(moves[i].upper, moves[i].axis, moves[i].from) == std::tie(moves[i - 1].upper, moves[i - 1].axis, moves[i - 1].from))
+                return false;
+        moves.erase(std::remove_if(moves.begin(), moves.end(), [](const EdgeMove &m) { return m.from == m.to; }), moves.end());
+
+        auto index = [&](bool upper) -> EdgeIndex & { return upper ? state.upperEdges : state.lowerEdges; };
+        auto moved = [&](bool upper, int axis, int coordinate)
+        {
+            auto it = std::lower_bound(moves.begin(), moves.end(), EdgeMove{upper, axis, coordinate, INT_MIN});
+            return (it != moves.end() && it->upper == upper && it->axis == axis && it->from == coordinate) ? it->to : coordinate;
+        };
+        bool any = false;
+        for (const EdgeMove &m : moves)
+        {
+            const std::vector<ClusterId> *ids = index(m.upper).find(m.axis, m.from);
+            if (!ids)
+                continue;
+            any = true;
+            for (ClusterId id : *ids)
+            {
+                const Cluster &c = state.pool[id];
+                int size = moved(true, m.axis, c.upper[m.axis]) - moved(false, m.axis, c.lower[m.axis]);
+                if (size < minSize && size < c.upper[m.axis] - c.lower[m.axis])
+                    return false;
+            }
+        }
+        if (!any)
+            return false;
+
+        std::vector<std::vector<ClusterId>> taken;
+        for (const EdgeMove &m : moves)
+        {
+            taken.push_back(index(m.upper).take(m.axis, m.from));
+            for (ClusterId id : taken.back())
+                (m.upper ? state.pool.mut(id).upper : state.pool.mut(id).lower)[m.axis] = m.to;
+        }
+        //put back only after every line is out, a line may go where another one was
+        for (size_t i = 0; i < moves.size(); ++i)
+            index(moves[i].upper).add(moves[i].axis, moves[i].to, taken[i]);
+        return true;
+    }
+
+    //Both sides of every target separator, the clusters before it end at its near side and the ones
+    //after it start at its far side. False if a target is no separator
+    bool addSeparatorMoves(const std::vector<SeparatorTarget> &targets, std::vector<EdgeMove> &moves) const
+    {
+        for (const SeparatorTarget &t : targets)
+        {
+            if (t.cluster >= state.pool.capacity() || !state.pool[t.cluster].alive || state.pool[t.cluster].isLeaf())
+                return false;
+            int axis = !isVertical(t.cluster);
+            ClusterId children = state.pool[t.cluster].children;
+            int lower_edge = state.pool[children].upper[axis];
+            int upper_edge = state.pool[children + 1].lower[axis];
+            moves.push_back({true, axis, lower_edge, t.position});
+            moves.push_back({false, axis, upper_edge, t.position + upper_edge - lower_edge});
+        }
+        return true;
+    }
+
+    Cluster make(glm::ivec2 lower, glm::ivec2 upper, ClusterId parent)
+    {
+        Cluster c(lower, upper, parent);
+        c.serial = nextSerial++;
+        return c;
+    }
+
+    void split(ClusterId id, glm::ivec2 separator_pos, int separator_width, bool isVertical)
+    {
+        glm::ivec2 lower = state.pool[id].lower, upper = state.pool[id].upper;
+        ClusterId children;
+        if (isVertical)
+        {
+            children = state.pool.createPair(make(lower, glm::ivec2(separator_pos.x , upper.y), id),
+                                             make(glm::ivec2(separator_pos.x + separator_width, lower.y), upper, id));
+        }
+        else
+        {
+            children = state.pool.createPair(make(lower, glm::ivec2(upper.x, separator_pos.y ), id),
+                                             make(glm::ivec2(lower.x, separator_pos.y + separator_width), upper, id));
+        }
+        state.pool.mut(id).children = children;
+    }
 
 public:
-    glm::vec3 getPos(Cluster *c)
+    const Cluster &get(ClusterId id) const
+    {
+        return state.pool[id];
+    }
+
+    //Links are kept by cluster serial outside the versions, so undo and redo leave them alone: a cluster
+    //an undo brings back has the object it had, even if its id went to another cluster in between, and
+    //the scene has to unlink objects it deletes. Clusters a split makes start unlinked
+    void setLinkedObject(ClusterId id, IObject *object)
+    {
+        uint32_t serial = state.pool[id].serial;
+        if (object)
+            links[serial] = object;
+        else
+            links.erase(serial);
+    }
+
+    //nullptr for clusters without an object and ones the current version doesn't have
+    IObject *getLinkedObject(ClusterId id) const
+    {
+        if (id >= state.pool.capacity() || !state.pool[id].alive)
+            return nullptr;
+        auto it = links.find(state.pool[id].serial);
+        return it == links.end() ? nullptr : it->second;
+    }
+
+    ClusterId getRoot() const
+    {
+        return state.root;
+    }
+
+    //how deep the wardrobe is, in the units of the cluster bounds
+    int getDepth() const
     {
-        if(c->isVertical())
-            return origin + glm::vec3(to_mm(c->firstChild->upper.x), to_mm(c->firstChild->lower.y),0);
-        return origin + glm::vec3(to_mm(c->firstChild->lower.x), to_mm(c->firstChild->upper.y),0);
+        return depth;
     }
 
-    glm::vec3 getScale(Cluster *c)
+    //The current version, a copy of it stays as it is and can be compared with later ones
+    const ClusterState &getState() const
     {
-        if (c->isVertical())
+        return state;
+    }
+
+    //Live clusters, inner ones too, parents before children
+    std::vector<ClusterId> getClusters() const
+    {
+        std::vector<ClusterId> order = { state.root };
+        for (size_t i = 0; i < order.size(); ++i)
+        {
+            ClusterId children = state.pool[order[i]].children;
+            if (children == NO_CLUSTER)
+                continue;
+            order.push_back(children);
+            order.push_back(children + 1);
+        }
+        return order;
+    }
+
+    bool isVertical(ClusterId id) const
+    {
+        ClusterId children = state.pool[id].children;
+        return state.pool[children].lower.y == state.pool[children + 1].lower.y;
+    }
+
+    //Leaf that holds pos, NO_CLUSTER if pos is on a separator. Descends the flat array, the first call
+    //after an edit lays it out again in O(n). Not safe to call from two threads while that happens
+    ClusterId toLocalCluster(glm::ivec2 pos) const
+    {
+        if (flat.empty())
+            buildFlat();
+        uint32_t i = 0;
+        while (flat[i].children != NO_CLUSTER)
+        {
+            const FlatNode &node = flat[i];
+            if (pos[node.axis] < node.nearSide)
+                i = node.children;
+            else if (pos[node.axis] > node.farSide)
+                i = node.children + 1;
+            else
+                return NO_CLUSTER;
+        }
+        return flat[i].id;
+    }
+
+    glm::vec3 getPos(ClusterId id) const
+    {
+        const Cluster &first = state.pool[state.pool[id].children];
+        if(isVertical(id))
+            return origin + glm::vec3(to_mm(first.upper.x), to_mm(first.lower.y),0);
+        return origin + glm::vec3(to_mm(first.lower.x), to_mm(first.upper.y),0);
+    }
+
+    glm::vec3 getScale(ClusterId id) const
+    {
+        const Cluster &c = state.pool[id];
+        const Cluster &first = state.pool[c.children];
+        const Cluster &second = state.pool[c.children + 1];
+        if (isVertical(id))
         {
-            return glm::vec3(to_mm((c->firstChild->upper.x - c->secondChild->lower.x)) * -1,
-                             to_mm(c->upper.y - c->lower.y), 
+            return glm::vec3(to_mm((first.upper.x - second.lower.x)) * -1,
+                             to_mm(c.upper.y - c.lower.y),
                              to_mm(depth));
         }
         else
         {
-            return glm::vec3(to_mm(c->upper.x - c->lower.x), 
-                             to_mm(c->firstChild->upper.y - c->secondChild->lower.y) * -1, 
+            return glm::vec3(to_mm(c.upper.x - c.lower.x),
+                             to_mm(first.upper.y - second.lower.y) * -1,
                              to_mm(depth));
         }
     }
@@ -126,95 +678,209 @@ public:
     {
         glm::ivec2 size2d = glm::ivec2(size.x, size.y);
         depth = size.z;
-        root = new Cluster(glm::ivec2(), size2d);
-        clusters.push_back(root);
+        state.root = state.pool.createRoot(glm::ivec2(), size2d);
+        addEdges(state.root);
     }
 
-    Cluster *trySplit(glm::vec3 pos, int width, bool isVertical)
+    ClusterId trySplit(glm::vec3 pos, int width, bool isVertical)
     {
         glm::ivec2 pos2d = glm::ivec2(from_mm(pos.x - origin.x),from_mm(pos.y - origin.y));
-        Cluster *c = root->toLocalCluster(pos2d);
-        if (c)
+        ClusterId id = findLeaf(pos2d);
+        record([&]
         {
-            c->split(pos2d, width, isVertical);
-            clusters.push_back(c->firstChild);
-            clusters.push_back(c->secondChild);
-        }
-        return c;
+            if (id == NO_CLUSTER)
+                return false;
+            split(id, pos2d, width, isVertical);
+            ClusterId children = state.pool[id].children;
+            addEdges(children);
+            addEdges(children + 1);
+            return true;
+        });
+        return id;
     }
 
-    void tryMoveSeparator(Cluster *c, int delta)
+    void tryMoveSeparator(ClusterId id, int delta)
     {
-        int target = !c->isVertical();
-        std::vector<Cluster *> upper_clusters;
-        std::vector<Cluster *> lower_clusters;
-
-        int thiccness = c->secondChild->lower[target] - c->firstChild->upper[target] ;
-        for (Cluster *cluster : clusters)
+        record([&]
         {
-            if (cluster->lower[target] == c->secondChild->lower[target])
+            int target = !isVertical(id);
+            ClusterId children = state.pool[id].children;
+            int upper_edge = state.pool[children + 1].lower[target];
+            int lower_edge = state.pool[children].upper[target];
+            const std::vector<ClusterId> *upper_clusters = state.lowerEdges.find(target, upper_edge);
+            const std::vector<ClusterId> *lower_clusters = state.upperEdges.find(target, lower_edge);
+
+            int thiccness = upper_edge - lower_edge;
+            if (delta > 0 && upper_clusters)
             {
-                upper_clusters.push_back(cluster);
+                int new_pos = lower_edge + delta;
+                for (ClusterId cluster : *upper_clusters)
+                    if (new_pos > state.pool[cluster].upper[target] - thiccness)
+                        return false;
             }
-
-            if (cluster->upper[target] == c->firstChild->upper[target])
+            else if (delta <= 0 && lower_clusters)
             {
-                lower_clusters.push_back(cluster);
+                int new_pos = upper_edge + delta;
+                for (ClusterId cluster : *lower_clusters)
+                    if (new_pos < state.pool[cluster].lower[target] + thiccness)
+                        return false;
             }
-        }
+            if (delta == 0)
+                return false;
 
-        if (delta > 0)
-        {
-            int new_pos = c->firstChild->upper[target] + delta;
-            for (Cluster *cluster : upper_clusters)
-                if (new_pos > cluster->upper[target] - thiccness)
-                    return;
-        }
-        else
-        {
-            int new_pos = c->secondChild->lower[target] + delta;
-            for (Cluster *cluster : lower_clusters)
-                if (new_pos < cluster->lower[target] + thiccness)
-                    return;
-        }
+            if (upper_clusters)
+                for (ClusterId cluster : *upper_clusters)
+                    state.pool.mut(cluster).lower[target] += delta;
+
+            if (lower_clusters)
+                for (ClusterId cluster : *lower_clusters)
+                    state.pool.mut(cluster).upper[target] += delta;
 
-        for (Cluster *cluster : upper_clusters)
-            cluster->lower[target] += delta;
+            state.lowerEdges.move(target, upper_edge, upper_edge + delta);
+            state.upperEdges.move(target, lower_edge, lower_edge + delta);
+            return true;
+        });
+    }
+
+    //Puts many separators where targets says as one edit, one step for undo. Every separator drags the
+    //edges lying on its line along, like tryMoveSeparator. Rejected as a whole if a compartment would get
+    //smaller than minSize or two targets want one line in different places
+    bool trySetSeparators(const std::vector<SeparatorTarget> &targets, int minSize = 0)
+    {
+        return record([&]
+        {
+            std::vector<EdgeMove> moves;
+            return addSeparatorMoves(targets, moves) && moveEdges(std::move(moves), minSize);
+        });
+    }
 
-        for (Cluster *cluster : lower_clusters)
-            cluster->upper[target] += delta;
+    //Gives the whole design a new size, the outer upper edges move and the compartments along them
+    //grow or shrink. targets are put in place in the same edit, so separators can make room first
+    bool tryResize(glm::ivec2 size, const std::vector<SeparatorTarget> &targets = {}, int minSize = 0)
+    {
+        return record([&]
+        {
+            std::vector<EdgeMove> moves;
+            glm::ivec2 upper = state.pool[state.root].upper;
+            for (int axis = 0; axis < 2; ++axis)
+                moves.push_back({true, axis, upper[axis], size[axis]});
+            return addSeparatorMoves(targets, moves) && moveEdges(std::move(moves), minSize);
+        });
     }
 
-    std::vector<Cluster*> getClustersToDelete(Cluster* c)
+    //Takes the subtree under id off the tree, id becomes a leaf. The removed clusters go back to the pool,
+    //they can be read until the next split
+    std::vector<ClusterId> getClustersToDelete(ClusterId id)
     {
-        std::vector<Cluster*> toDelete = std::vector<Cluster*>();
-        std::stack<Cluster*> s = std::stack<Cluster*>();
-        s.push(c->firstChild);
-        s.push(c->secondChild);
-        while(!s.empty())
+        std::vector<ClusterId> toDelete = std::vector<ClusterId>();
+        record([&]
         {
-            Cluster* current = s.top(); s.pop();
-            toDelete.push_back(current);
-            if (!current->isLeaf())
+            std::vector<ClusterId> pairs = std::vector<ClusterId>();
+            std::stack<ClusterId> s = std::stack<ClusterId>();
+            s.push(id);
+            while(!s.empty())
             {
-                s.push(current->firstChild);
-                s.push(current->secondChild);
+                ClusterId current = s.top(); s.pop();
+                ClusterId children = state.pool[current].children;
+                if (children == NO_CLUSTER)
+                    continue;
+                pairs.push_back(children);
+                toDelete.push_back(children);
+                toDelete.push_back(children + 1);
+                s.push(children);
+                s.push(children + 1);
             }
-        }
+            if (toDelete.empty())
+                return false;
+
+            state.pool.mut(id).children = NO_CLUSTER;
+
+            for (ClusterId cluster : toDelete)
+                state.pool.mut(cluster).alive = false;
+            removeDeadEdges(toDelete);
+            for (ClusterId children : pairs)
+                state.pool.releasePair(children);
+            return true;
+        });
+        return toDelete;
+    }
+
+    //Steps back to the version before the last edit, O(1). Ids taken after that edit mean nothing there
+    bool undo()
+    {
+        if (undoStack.empty())
+            return false;
+        redoStack.push_back(std::move(state));
+        state = std::move(undoStack.back());
+        undoStack.pop_back();
+        flat.clear();
+        return true;
+    }
+
+    bool redo()
+    {
+        if (redoStack.empty())
+            return false;
+        undoStack.push_back(std::move(state));
+        state = std::move(redoStack.back());
+        redoStack.pop_back();
+        flat.clear();
+        return true;
+    }
+
+    bool canUndo() const
+    {
+        return !undoStack.empty();
+    }
 
-        c->firstChild = nullptr;
-        c->secondChild = nullptr;
-        
-        for (auto &cluster : toDelete)
+    bool canRedo() const
+    {
+        return !redoStack.empty();
+    }
+
+    //Lays the current version out again breadth first with no free pairs in between, so point location
+    //and walks over the tree read the nodes front to back. It is not an edit, the history keeps its own
+    //layouts: after an undo ids are the ones of that version again. Links go by serial, which every
+    //layout shares, so they stay right either way. Changes ids: returns the new id of every old one,
+    //NO_CLUSTER for the free ones
+    std::vector<ClusterId> compact()
+    {
+        std::vector<ClusterId> order = getClusters();
+        std::vector<ClusterId> newId(state.pool.capacity(), NO_CLUSTER);
+        for (size_t i = 0; i < order.size(); ++i)
+            newId[order[i]] = i;
+        ClusterPool pool;
+        for (size_t i = 0; i < order.size(); ++i)
         {
-            clusters.erase(std::remove(clusters.begin(), clusters.end(), cluster), clusters.end());
+            Cluster c = state.pool[order[i]];
+            if (!c.isLeaf()) c.children = newId[c.children];
+            if (!c.isRoot()) c.parent = newId[c.parent];
+            if (i == 0)
+            {
+                pool.createRoot(c.lower, c.upper);
+                pool.mut(0) = c;
+            }
+            else if (i % 2 == 1)
+            {
+                Cluster second = state.pool[order[i + 1]];
+                if (!second.isLeaf()) second.children = newId[second.children];
+                second.parent = newId[second.parent];
+                pool.createPair(c, second);
+                ++i;
+            }
         }
-
-        return toDelete;
+        state.pool = std::move(pool);
+        state.root = 0;
+        state.lowerEdges.remap(newId);
+        state.upperEdges.remap(newId);
+        flat.clear();
+        return newId;
     }
 
     ClusterManager() = default;
     ~ClusterManager() = default;
+
+    friend class ClusterIO;
 };
 
-#endif // CLUSTER_HH
\ No newline at end of file
+#endif // CLUSTER_HH
@@ -0,0 +1,402 @@
+#if !defined(CLUSTER_FILE_HH)
+#define CLUSTER_FILE_HH
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <functional>
+#include <fstream>
+#include <stdexcept>
+#include <cstring>
+#include <unordered_map>
+#include "Cluster.h"
+#include "MappedFile.h"
+#include "../thirdparty/json.hpp"
+
+//How linked objects are written and made again. A design only points at scene objects, the scene knows
+//what they are: save gives an object as json, load makes one from that json and the caller owns it.
+//Without save no objects are written, without load clusters come back unlinked
+struct ObjectCodec
+{
+    std::function<nlohmann::json(const IObject *)> save;
+    std::function<IObject *(const nlohmann::json &)> load;
+};
+
+class DesignCatalog;
+
+//Saving and loading designs. The binary form is a catalog of designs made for fast startup: a header,
+//a directory with one entry per design, then for every design its name, its clusters breadth first as
+//fixed records and its objects as MessagePack blobs. DesignCatalog maps such a file and builds a design,
+//or only a subtree of one, when it is asked for. The json form holds one design as a nested tree and
+//is meant for interchange. Cluster ids in both are the ones compact() would give. Undo history is not saved
+class ClusterIO
+{
+private:
+    static constexpr uint32_t NO_OBJECT = UINT32_MAX;
+
+    struct Header
+    {
+        char magic[4];
+        uint32_t version;
+        uint32_t designs;
+        uint32_t reserved;
+    };
+    struct DirectoryEntry
+    {
+        uint64_t name;
+        uint32_t nameLength;
+        uint32_t nodeCount;
+        uint64_t nodes;
+        uint64_t objects;
+        uint32_t objectCount;
+        int32_t depth;
+        float origin[3];
+        uint32_t reserved;
+    };
+    //children is the record of the first child, the second one follows it
+    struct NodeRecord
+    {
+        int32_t lower[2];
+        int32_t upper[2];
+        uint32_t children;
+        uint32_t object;
+    };
+    struct ObjectEntry
+    {
+        uint64_t offset;
+        uint64_t length;
+    };
+
+    //Records and objects of a design in file order, what both forms are written from
+    struct Flat
+    {
+        std::vector<NodeRecord> nodes;
+        std::vector<const IObject *> objects;
+    };
+
+    static Flat flatten(const ClusterManager &design, const ObjectCodec &codec)
+    {
+        Flat flat;
+        std::vector<ClusterId> order = design.getClusters();
+        std::vector<uint32_t> record(design.state.pool.capacity(), NO_CLUSTER);
+        for (size_t i = 0; i < order.size(); ++i)
+            record[order[i]] = i;
+        std::unordered_map<const IObject *, uint32_t> objectIds;
+        for (ClusterId id : order)
+        {
+            const Cluster &c = design.state.pool[id];
+            NodeRecord r = {{c.lower.x, c.lower.y}, {c.upper.x, c.upper.y}, NO_CLUSTER, NO_OBJECT};
+            if (!c.isLeaf())
+                r.children = record[c.children];
+            const IObject *linked = design.getLinkedObject(id);
+            if (linked && codec.save)
+            {
+                auto [it, added] = objectIds.emplace(linked, flat.objects.size());
+                if (added)
+                    flat.objects.push_back(linked);
+                r.object = it->second;
+            }
+            flat.nodes.push_back(r);
+        }
+        return flat;
+    }
+
+    //Builds the subtree under record top as a design of its own. node(i) reads record i and object(k)
+    //makes object k. Children have to come after their parent and be nobody else's, so a broken file
+    //can't make the walk go round or blow up
+    template <class Node, class Object>
+    static ClusterManager build(glm::vec3 origin, int depth, uint32_t count, uint32_t top, Node node, Object object)
+    {
+        if (top >= count)
+            throw std::runtime_error("No cluster " + std::to_string(top) + " in the design");
+        ClusterManager design;
+        design.origin = origin;
+        design.depth = depth;
+        ClusterState &state = design.state;
+        NodeRecord r = node(top);
+        state.root = state.pool.createRoot(glm::ivec2(r.lower[0], r.lower[1]), glm::ivec2(r.upper[0], r.upper[1]));
+        design.setLinkedObject(state.root, object(r.object));
+        design.addEdges(state.root);
+        std::vector<bool> used(count);
+        std::vector<std::pair<uint32_t, ClusterId>> queue = {{top, state.root}};
+        for (size_t i = 0; i < queue.size(); ++i)
+        {
+            auto [at, id] = queue[i];
+            uint32_t children = node(at).children;
+            if (children == NO_CLUSTER)
+                continue;
+            if (children <= at || children >= count - 1 || used[children] || used[children + 1])
+                throw std::runtime_error("Broken cluster tree at record " + std::to_string(at));
+            used[children] = true;
+            used[children + 1] = true;
+            NodeRecord a = node(children), b = node(children + 1);
+            Cluster first = design.make(glm::ivec2(a.lower[0], a.lower[1]), glm::ivec2(a.upper[0], a.upper[1]), id);
+            Cluster second = design.make(glm::ivec2(b.lower[0], b.lower[1]), glm::ivec2(b.upper[0], b.upper[1]), id);
+            ClusterId pair = state.pool.createPair(first, second);
+            state.pool.mut(id).children = pair;
+            design.setLinkedObject(pair, object(a.object));
+            design.setLinkedObject(pair + 1, object(b.object));
+            design.addEdges(pair);
+            design.addEdges(pair + 1);
+            queue.push_back({children, pair});
+            queue.push_back({children + 1, pair + 1});
+        }
+        return design;
+    }
+
+    static void pad(std::string &out)
+    {
+        out.resize((out.size() + 7) / 8 * 8, '\0');
+    }
+
+    template <class T>
+    static uint64_t append(std::string &out, const T *data, size_t count)
+    {
+        pad(out);
+        uint64_t offset = out.size();
+        out.append((const char *)data, count * sizeof(T));
+        return offset;
+    }
+
+public:
+    //Writes designs, each with its name, to one binary catalog
+    static void save(const std::string &path, const std::vector<std::pair<std::string, const ClusterManager *>> &designs, const ObjectCodec &codec = {})
+    {
+        std::vector<DirectoryEntry> directory;
+        std::string out(sizeof(Header) + designs.size() * sizeof(DirectoryEntry), '\0');
+        for (auto &[name, design] : designs)
+        {
+            Flat flat = flatten(*design, codec);
+            DirectoryEntry e = {};
+            e.name = append(out, name.data(), name.size());
+            e.nameLength = name.size();
+            e.nodeCount = flat.nodes.size();
+            e.nodes = append(out, flat.nodes.data(), flat.nodes.size());
+            std::vector<ObjectEntry> objects;
+            for (const IObject *o : flat.objects)
+            {
+                std::vector<uint8_t> blob = nlohmann::json::to_msgpack(codec.save(o));
+                objects.push_back({append(out, blob.data(), blob.size()), blob.size()});
+            }
+            e.objects = append(out, objects.data(), objects.size());
+            e.objectCount = objects.size();
+            e.depth = design->depth;
+            e.origin[0] = design->origin.x;
+            e.origin[1] = design->origin.y;
+            e.origin[2] = design->origin.z;
+            directory.push_back(e);
+        }
+        Header h = {{'W', 'D', 'S', 'G'}, 1, (uint32_t)designs.size(), 0};
+        memcpy(&out[0], &h, sizeof(h));
+        memcpy(&out[sizeof(h)], directory.data(), directory.size() * sizeof(DirectoryEntry));
+        std::ofstream os(path, std::ios::binary);
+        os.write(out.data(), out.size());
+        if (!os)
+            throw std::runtime_error("Can't write " + path);
+    }
+
+    //{"version":1, "origin":[x,y,z], "depth":d, "objects":[...], "root":node}, where a node is
+    //{"lower":[x,y], "upper":[x,y]} with "children":[node,node] if it is split and "object":k if it has one
+    static nlohmann::json toJson(const ClusterManager &design, const ObjectCodec &codec = {})
+    {
+        Flat flat = flatten(design, codec);
+        nlohmann::json j = {{"version", 1}, {"origin", {design.origin.x, design.origin.y, design.origin.z}}, {"depth", design.depth}};
+        nlohmann::json objects = nlohmann::json::array();
+        for (const IObject *o : flat.objects)
+            objects.push_back(codec.save(o));
+        j["objects"] = std::move(objects);
+        //nodes are filled breadth first, a node's children array is written once so pointers into it stay good
+        std::vector<std::pair<uint32_t, nlohmann::json *>> queue = {{0, &j["root"]}};
+        for (size_t i = 0; i < queue.size(); ++i)
+        {
+            auto [at, out] = queue[i];
+            const NodeRecord &r = flat.nodes[at];
+            *out = {{"lower", {r.lower[0], r.lower[1]}}, {"upper", {r.upper[0], r.upper[1]}}};
+            if (r.object != NO_OBJECT)
+                (*out)["object"] = r.object;
+            if (r.children == NO_CLUSTER)
+                continue;
+            nlohmann::json &children = (*out)["children"];
+            children = nlohmann::json::array({nullptr, nullptr});
+            queue.push_back({r.children, &children[0]});
+            queue.push_back({r.children + 1, &children[1]});
+        }
+        return j;
+    }
+
+    static ClusterManager fromJson(const nlohmann::json &j, const ObjectCodec &codec = {})
+    {
+        try
+        {
+            if (j.at("version").get<int>() != 1)
+                throw std::runtime_error("Unknown design version " + j.at("version").dump());
+            const nlohmann::json &objects = j.at("objects");
+            std::vector<NodeRecord> nodes;
+            std::vector<const nlohmann::json *> queue = {&j.at("root")};
+            for (size_t i = 0; i < queue.size(); ++i)
+            {
+                const nlohmann::json &n = *queue[i];
+                const nlohmann::json &lower = n.at("lower"), &upper = n.at("upper");
+                NodeRecord r = {{lower.at(0).get<int32_t>(), lower.at(1).get<int32_t>()}, {upper.at(0).get<int32_t>(), upper.at(1).get<int32_t>()},
+                                NO_CLUSTER, n.value("object", NO_OBJECT)};
+                if (r.object != NO_OBJECT && r.object >= objects.size())
+                    throw std::runtime_error("No object " + std::to_string(r.object));
+                if (n.contains("children"))
+                {
+                    const nlohmann::json &children = n.at("children");
+                    if (children.size() != 2)
+                        throw std::runtime_error("A split has two children");
+                    r.children = queue.size();
+                    queue.push_back(&children[0]);
+                    queue.push_back(&children[1]);
+                }
+                nodes.push_back(r);
+            }
+            std::vector<IObject *> made(objects.size(), nullptr);
+            const nlohmann::json &origin = j.at("origin");
+            return build(glm::vec3(origin.at(0).get<float>(), origin.at(1).get<float>(), origin.at(2).get<float>()), j.at("depth").get<int>(), nodes.size(), 0,
+                         [&](uint32_t i) { return nodes[i]; },
+                         [&](uint32_t k) -> IObject *
+                         {
+                             if (k == NO_OBJECT || !codec.load)
+                                 return nullptr;
+                             if (!made[k])
+                                 made[k] = codec.load(objects[k]);
+                             return made[k];
+                         });
+        }
+        catch (const nlohmann::json::exception &e)
+        {
+            throw std::runtime_error(std::string("Bad design json, ") + e.what());
+        }
+    }
+
+    static void saveJson(const std::string &path, const ClusterManager &design, const ObjectCodec &codec = {})
+    {
+        std::ofstream os(path);
+        os << toJson(design, codec).dump(1, '\t') << "\n";
+        if (!os)
+            throw std::runtime_error("Can't write " + path);
+    }
+
+    static ClusterManager loadJson(const std::string &path, const ObjectCodec &codec = {})
+    {
+        mapped_file file(path);
+        try
+        {
+            return fromJson(nlohmann::json::parse(file.text()), codec);
+        }
+        catch (const std::exception &e)
+        {
+            throw std::runtime_error(path + ", " + e.what());
+        }
+    }
+
+    friend class DesignCatalog;
+};
+
+//A binary catalog written by ClusterIO::save, mapped and read in place. Opening it only checks the header
+//and directory, a design is built when load() asks for it and only the records of the subtree it builds
+//are read, so the OS pages in just the part of the file that is looked at
+class DesignCatalog
+{
+private:
+    mapped_file file;
+    std::string path;
+    const ClusterIO::DirectoryEntry *directory = nullptr;
+    uint32_t designs = 0;
+
+    [[noreturn]] void broken() const
+    {
+        throw std::runtime_error(path + " is not a design catalog");
+    }
+
+    //count Ts at offset, checked against the file
+    template <class T>
+    const T *at(uint64_t offset, uint64_t count) const
+    {
+        std::string_view data = file.text();
+        if (offset % alignof(T) || offset > data.size() || count > (data.size() - offset) / sizeof(T))
+            broken();
+        return (const T *)(data.data() + offset);
+    }
+
+    const ClusterIO::DirectoryEntry &entry(size_t design) const
+    {
+        if (design >= designs)
+            throw std::runtime_error("No design " + std::to_string(design) + " in " + path);
+        return directory[design];
+    }
+
+public:
+    explicit DesignCatalog(const std::string &path) : file(path), path(path)
+    {
+        const ClusterIO::Header &h = *at<ClusterIO::Header>(0, 1);
+        if (memcmp(h.magic, "WDSG", 4) || h.version != 1)
+            broken();
+        designs = h.designs;
+        directory = at<ClusterIO::DirectoryEntry>(sizeof(h), designs);
+        //everything load() reads is checked here, but for the object blobs
+        for (uint32_t i = 0; i < designs; ++i)
+        {
+            at<char>(directory[i].name, directory[i].nameLength);
+            at<ClusterIO::NodeRecord>(directory[i].nodes, directory[i].nodeCount);
+            at<ClusterIO::ObjectEntry>(directory[i].objects, directory[i].objectCount);
+        }
+    }
+
+    size_t size() const
+    {
+        return designs;
+    }
+
+    std::string name(size_t design) const
+    {
+        const ClusterIO::DirectoryEntry &e = entry(design);
+        return std::string(at<char>(e.name, e.nameLength), e.nameLength);
+    }
+
+    size_t clusterCount(size_t design) const
+    {
+        return entry(design).nodeCount;
+    }
+
+    //Builds design, or only the subtree under cluster subtree of it, that cluster becomes the root
+    ClusterManager load(size_t design, const ObjectCodec &codec = {}, ClusterId subtree = 0) const
+    {
+        const ClusterIO::DirectoryEntry &e = entry(design);
+        const ClusterIO::NodeRecord *nodes = at<ClusterIO::NodeRecord>(e.nodes, e.nodeCount);
+        const ClusterIO::ObjectEntry *objects = at<ClusterIO::ObjectEntry>(e.objects, e.objectCount);
+        std::string_view data = file.text();
+        std::unordered_map<uint32_t, IObject *> made;
+        try
+        {
+            return ClusterIO::build(glm::vec3(e.origin[0], e.origin[1], e.origin[2]), e.depth, e.nodeCount, subtree,
+                                    [&](uint32_t i) { return nodes[i]; },
+                                    [&](uint32_t k) -> IObject *
+                                    {
+                                        if (k == ClusterIO::NO_OBJECT || !codec.load)
+                                            return nullptr;
+                                        if (k >= e.objectCount || objects[k].offset > data.size() || objects[k].length > data.size() - objects[k].offset)
+                                            throw std::runtime_error("bad object " + std::to_string(k));
+                                        auto [it, added] = made.emplace(k, nullptr);
+                                        if (added)
+                                        {
+                                            const uint8_t *blob = (const uint8_t *)data.data() + objects[k].offset;
+                                            it->second = codec.load(nlohmann::json::from_msgpack(blob, blob + objects[k].length));
+                                        }
+                                        return it->second;
+                                    });
+        }
+        catch (const nlohmann::json::exception &e)
+        {
+            throw std::runtime_error(path + ", bad object, " + e.what());
+        }
+        catch (const std::runtime_error &e)
+        {
+            throw std::runtime_error(path + ", design " + std::to_string(design) + ", " + e.what());
+        }
+    }
+};
+
+#endif // CLUSTER_FILE_HH
@@ -0,0 +1,185 @@
+#pragma once
+#include "PackSession.h"
+#include "Cluster.h"
+
+//Every split of a wardrobe is a separator panel: as long as the cluster it splits, as thick as the gap
+//between its children and as wide as the wardrobe is deep. Sizes come straight from the integer bounds,
+//in mm. Its cut part is length x depth with the front edge, the south one, banded. Splits without
+//thickness only divide a compartment and give no panel.
+//Returns the part in cast_input_vector format, empty if the cluster has no panel
+vector<int> panel_part(const ClusterManager& clusters, ClusterId id)
+{
+	const ClusterState& state = clusters.getState();
+	if ((id >= state.pool.capacity()) || !state.pool[id].isAlive() || state.pool[id].isLeaf())
+		return {};
+	const Cluster& c = state.pool[id];
+	const Cluster& first = state.pool[c.getChildren()];
+	const Cluster& second = state.pool[c.getChildren() + 1];
+	//a vertical separator lies across x and runs along y
+	int across = !clusters.isVertical(id);
+	if (second.getLower()[across] - first.getUpper()[across] <= 0)
+		return {};
+	int length = c.getUpper()[!across] - c.getLower()[!across];
+	return { 0, 0, 1, 0, length, clusters.getDepth() };
+}
+
+//Panels of the whole design, parents before children. owners gets the cluster of every part if given
+vector<vector<int>> panel_list(const ClusterManager& clusters, vector<ClusterId>* owners = nullptr)
+{
+	vector<vector<int>> parts;
+	for (ClusterId id : clusters.getClusters())
+	{
+		vector<int> part = panel_part(clusters, id);
+		if (part.empty())
+			continue;
+		parts.push_back(move(part));
+		if (owners)
+			owners->push_back(id);
+	}
+	return parts;
+}
+
+//Keeps the cut list of a design packed while it is edited. update() compares the design with the version
+//it saw last and only looks at the clusters written in between, that is the ones an edit moved and their
+//parents. Panels that changed are resized, added or removed in a pack_session, the rest stay where they are
+class cut_list_session
+{
+private:
+	struct change
+	{
+		ClusterId id;
+		vector<int> part;
+	};
+
+	pack_session session;
+	int dsp_w, dsp_h;
+	ClusterState seen;
+	vector <int> part_of;       //session part of every cluster id, -1 if it has no panel
+	vector <vector<int>> parts; //panel of every cluster id as it was packed
+	int panels = 0;
+	int changed = 0;
+
+	//Throws like pack_session would if a panel fits no sheet, before anything is changed
+	void check_fit(const vector<int>& part) const
+	{
+		Rectangle r = cast_input_vector({ part })[0];
+		fit_part_to_dsp(r, dsp_w, dsp_h);
+	}
+
+	void rebuild(const ClusterManager& clusters)
+	{
+		vector<ClusterId> owners;
+		vector<vector<int>> list = panel_list(clusters, &owners);
+		for (auto& part : list)
+			check_fit(part);
+		size_t capacity = clusters.getState().pool.capacity();
+		vector <int> new_part_of(capacity, -1);
+		vector <vector<int>> new_parts(capacity);
+		for (int i = 0; i < list.size(); ++i)
+		{
+			new_part_of[owners[i]] = i;
+			new_parts[owners[i]] = list[i];
+		}
+		session.assign(cast_input_vector(list));
+		part_of = move(new_part_of);
+		parts = move(new_parts);
+		panels = list.size();
+		changed = list.size();
+	}
+
+public:
+	cut_list_session(int dsp_w, int dsp_h, int saw_width = 10, double repack_threshold = 0.95)
+		: session(dsp_w, dsp_h, saw_width, repack_threshold), dsp_w(dsp_w), dsp_h(dsp_h)
+	{
+	}
+
+	//Brings the plan up to the current version of clusters, undo and redo included. If a panel fits
+	//no sheet it throws and the session stays on the version it saw before
+	void update(const ClusterManager& clusters)
+	{
+		const ClusterState& now = clusters.getState();
+		vector<ClusterId> touched;
+		now.pool.changed(seen.pool, [&](size_t id) { touched.push_back(id); });
+		//a panel is as thick as the gap between the children of its cluster, so moving them changes it
+		size_t n = touched.size();
+		for (size_t i = 0; i < n; ++i)
+		{
+			ClusterId id = touched[i];
+			if ((id < now.pool.capacity()) && now.pool[id].isAlive() && !now.pool[id].isRoot())
+				touched.push_back(now.pool[id].getParent());
+		}
+		sort(touched.begin(), touched.end());
+		touched.erase(unique(touched.begin(), touched.end()), touched.end());
+		//the pool diff works in whole trie leaves, so touched holds many clusters whose panel is the same
+		vector<change> changes;
+		int added = 0;
+		for (ClusterId id : touched)
+		{
+			vector<int> part = panel_part(clusters, id);
+			const vector<int>& old = id < parts.size() ? parts[id] : vector<int>();
+			if (part == old)
+				continue;
+			if (!part.empty())
+				check_fit(part);
+			added += old.empty() - part.empty();
+			changes.push_back({ id, move(part) });
+		}
+		//after compact() or a first look most panels are new, planning from scratch is cheaper then
+		if (changes.size() * 2 > max(panels, panels + added))
+		{
+			rebuild(clusters);
+			seen = now;
+			return;
+		}
+		//nothing below throws, the session and the panels are changed together
+		part_of.resize(max(part_of.size(), now.pool.capacity()), -1);
+		parts.resize(part_of.size());
+		for (change& c : changes)
+		{
+			if (!c.part.empty() && !parts[c.id].empty())
+				session.resize(part_of[c.id], c.part[4], c.part[5]);
+			else if (!c.part.empty())
+				part_of[c.id] = session.add(cast_input_vector({ c.part })[0]);
+			else
+			{
+				session.remove(part_of[c.id]);
+				part_of[c.id] = -1;
+			}
+			parts[c.id] = move(c.part);
+		}
+		panels += added;
+		changed = changes.size();
+		seen = now;
+	}
+	//Panels added, resized or removed by the last update
+	int changed_count() const
+	{
+		return changed;
+	}
+
+	int sheet_count() const
+	{
+		return session.sheet_count();
+	}
+
+	double percentage() const
+	{
+		return session.percentage();
+	}
+
+	int repack_count() const
+	{
+		return session.repack_count();
+	}
+
+	//The plan in algorythm() form, part ids are session ids, part_id() gives the one of a cluster
+	vector <Rectangle> plan() const
+	{
+		return session.plan();
+	}
+
+	int part_id(ClusterId id) const
+	{
+		return id < part_of.size() ? part_of[id] : -1;
+	}
+};
@@ -0,0 +1,111 @@
+#pragma once
+#include <vector>
+#include <stack>
+
+//Node of the cut tree of one dsp list. A node is divided like Cluster::split divides a wardrobe:
+//the first child ends at the separator, the second one starts past the saw kerf.
+//Leaves are either a placed part or free space.
+struct cut_node
+{
+	int x = 0;
+	int y = 0;
+	int w = 0;
+	int h = 0;
+	int first = -1;
+	int second = -1;
+	bool vertical = false;
+	int part = -1;
+
+	bool is_leaf() const
+	{
+		return first == -1;
+	}
+};
+
+//One edge-to-edge pass of the saw: a vertical cut runs along y at x = position, a horizontal one along x
+struct saw_cut
+{
+	bool vertical;
+	int position;
+	int from;
+	int length;
+	int width;
+};
+
+class guillotine_sheet
+{
+private:
+	void split(int node, int separator_pos, bool vertical)
+	{
+		cut_node first = nodes[node], second = nodes[node];
+		if (vertical)
+		{
+			first.w = separator_pos - first.x;
+			second.x = separator_pos + saw_width;
+			second.w = nodes[node].x + nodes[node].w - second.x;
+		}
+		else
+		{
+			first.h = separator_pos - first.y;
+			second.y = separator_pos + saw_width;
+			second.h = nodes[node].y + nodes[node].h - second.y;
+		}
+		nodes[node].vertical = vertical;
+		nodes[node].first = nodes.size();
+		nodes[node].second = nodes.size() + 1;
+		nodes.push_back(first);
+		nodes.push_back(second);
+	}
+
+public:
+	std::vector<cut_node> nodes;
+	int saw_width;
+
+	guillotine_sheet(int width, int height, int saw_width) : saw_width(saw_width)
+	{
+		nodes.push_back({ 0, 0, width, height });
+	}
+
+	//Cuts w x h out of the lower corner of free leaf node with at most two cuts.
+	//The first cut goes along the axis with more material left, so the bigger leftover stays whole.
+	//Leftovers that still have area are appended to free_nodes
+	void place(int node, int w, int h, int part, std::vector<int>& free_nodes)
+	{
+		int dw = nodes[node].w - w, dh = nodes[node].h - h;
+		bool vertical_first = dw >= dh;
+		for (int pass = 0; pass < 2; ++pass)
+		{
+			bool vertical = (pass == 0) == vertical_first;
+			if ((vertical ? dw : dh) <= 0)
+				continue;
+			split(node, vertical ? nodes[node].x + w : nodes[node].y + h, vertical);
+			int rest = nodes[node].second;
+			if ((nodes[rest].w > 0) && (nodes[rest].h > 0))
+				free_nodes.push_back(rest);
+			node = nodes[node].first;
+		}
+		nodes[node].part = part;
+	}
+
+	//Saw passes in the order they have to be made: a cut always comes before the cuts inside its pieces
+	std::vector<saw_cut> cut_sequence() const
+	{
+		std::vector<saw_cut> cuts;
+		std::stack<int> s;
+		s.push(0);
+		while (!s.empty())
+		{
+			const cut_node& n = nodes[s.top()]; s.pop();
+			if (n.is_leaf())
+				continue;
+			const cut_node& first = nodes[n.first];
+			if (n.vertical)
+				cuts.push_back({ true, first.x + first.w, n.y, n.h, saw_width });
+			else
+				cuts.push_back({ false, first.y + first.h, n.x, n.w, saw_width });
+			s.push(n.second);
+			s.push(n.first);
+		}
+		return cuts;
+	}
+};
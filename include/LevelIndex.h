@@ -0,0 +1,227 @@
+#pragma once
+#include <vector>
+#include <algorithm>
+#include <climits>
+#if defined(__AVX2__) || defined(__SSE4_1__)
+#include <immintrin.h>
+#endif
+
+//Smallest space[k] over the levels with height[k] >= h, INT_MAX if there is none.
+//This is the inner reduction of the best-fit search, 8 levels per step with AVX2, 4 with SSE4.1
+inline int min_space_fitting(const int* height, const int* space, int n, int h)
+{
+	int k = 0;
+	int best = INT_MAX;
+#if defined(__AVX2__)
+	if (n >= 8)
+	{
+		__m256i hh = _mm256_set1_epi32(h - 1);
+		__m256i none = _mm256_set1_epi32(INT_MAX);
+		__m256i acc = none;
+		for (; k + 8 <= n; k += 8)
+		{
+			__m256i fits = _mm256_cmpgt_epi32(_mm256_loadu_si256((const __m256i*)(height + k)), hh);
+			__m256i s = _mm256_blendv_epi8(none, _mm256_loadu_si256((const __m256i*)(space + k)), fits);
+			acc = _mm256_min_epi32(acc, s);
+		}
+		__m128i m = _mm_min_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+		m = _mm_min_epi32(m, _mm_shuffle_epi32(m, _MM_SHUFFLE(1, 0, 3, 2)));
+		m = _mm_min_epi32(m, _mm_shuffle_epi32(m, _MM_SHUFFLE(2, 3, 0, 1)));
+		best = _mm_cvtsi128_si32(m);
+	}
+#elif defined(__SSE4_1__)
+	if (n >= 4)
+	{
+		__m128i hh = _mm_set1_epi32(h - 1);
+		__m128i none = _mm_set1_epi32(INT_MAX);
+		__m128i acc = none;
+		for (; k + 4 <= n; k += 4)
+		{
+			__m128i fits = _mm_cmpgt_epi32(_mm_loadu_si128((const __m128i*)(height + k)), hh);
+			__m128i s = _mm_blendv_epi8(none, _mm_loadu_si128((const __m128i*)(space + k)), fits);
+			acc = _mm_min_epi32(acc, s);
+		}
+		acc = _mm_min_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(1, 0, 3, 2)));
+		acc = _mm_min_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(2, 3, 0, 1)));
+		best = _mm_cvtsi128_si32(acc);
+	}
+#endif
+	for (; k < n; ++k)
+	{
+		if ((height[k] >= h) && (space[k] < best))
+			best = space[k];
+	}
+	return best;
+}
+
+//Best-fit lookup over the levels of BF.
+//Segment tree keyed by the free width of a level: every leaf is a bucket with the levels of that
+//free width, every node keeps the tallest height and the smallest space left below it.
+//A query walks only the free widths >= w and skips every subtree that is too low for h
+//or can't beat the best level found so far, so it touches O(log dsp_w) nodes in practice.
+//Buckets are kept as arrays of heights, spaces and level numbers, so a leaf is one min_space_fitting.
+//Ties are resolved by level number exactly like a linear scan over levels would do.
+class level_index
+{
+private:
+	struct level_bucket
+	{
+		std::vector<int> height;
+		std::vector<int> space;
+		std::vector<int> level;
+	};
+
+	int capacity = 1;
+	int max_free = 0;
+	std::vector<int> max_height;
+	std::vector<int> min_space;
+	std::vector<level_bucket> buckets;
+
+	std::vector<int> free_w;
+	std::vector<int> bucket_pos;
+
+	void pull(int node)
+	{
+		for (node /= 2; node > 0; node /= 2)
+		{
+			max_height[node] = std::max(max_height[node * 2], max_height[node * 2 + 1]);
+			min_space[node] = std::min(min_space[node * 2], min_space[node * 2 + 1]);
+		}
+	}
+
+	//A level leaving a bucket may have been its tallest or fullest one, so the bucket is rescanned
+	void refresh_leaf(int f)
+	{
+		const level_bucket& b = buckets[f];
+		int node = capacity + f;
+		int h = -1, s = INT_MAX;
+		for (size_t k = 0; k < b.level.size(); ++k)
+		{
+			h = std::max(h, b.height[k]);
+			s = std::min(s, b.space[k]);
+		}
+		max_height[node] = h;
+		min_space[node] = s;
+		pull(node);
+	}
+
+	//A level entering a bucket can only raise its height and lower its space
+	void merge_leaf(int f, int height, int space)
+	{
+		int node = capacity + f;
+		max_height[node] = std::max(max_height[node], height);
+		min_space[node] = std::min(min_space[node], space);
+		pull(node);
+	}
+
+	void insert(int level, int height, int space)
+	{
+		level_bucket& b = buckets[free_w[level]];
+		bucket_pos[level] = b.level.size();
+		b.height.push_back(height);
+		b.space.push_back(space);
+		b.level.push_back(level);
+	}
+
+	//Returns the height the level had in its bucket
+	int erase(int level)
+	{
+		level_bucket& b = buckets[free_w[level]];
+		int k = bucket_pos[level];
+		int height = b.height[k];
+		b.height[k] = b.height.back();
+		b.space[k] = b.space.back();
+		b.level[k] = b.level.back();
+		bucket_pos[b.level[k]] = k;
+		b.height.pop_back(); b.space.pop_back(); b.level.pop_back();
+		return height;
+	}
+
+	void search(int node, int lo, int hi, int w, int h, bool prefer_last, int& best_space, int& best_level) const
+	{
+		//equal space still has to be looked at, a level with a preferred number may be hiding there
+		if ((hi < w) || (max_height[node] < h) || (min_space[node] > best_space))
+			return;
+		if (node >= capacity)
+		{
+			const level_bucket& b = buckets[lo];
+			int n = b.level.size();
+			int least = min_space_fitting(b.height.data(), b.space.data(), n, h);
+			if ((least == INT_MAX) || (least > best_space))
+				return;
+			for (int k = 0; k < n; ++k)
+			{
+				if ((b.space[k] != least) || (b.height[k] < h))
+					continue;
+				int j = b.level[k];
+				if ((least < best_space) || (best_level == -1) || (prefer_last ? (j > best_level) : (j < best_level)))
+				{
+					best_space = least;
+					best_level = j;
+				}
+			}
+			return;
+		}
+		int mid = (lo + hi) / 2;
+		search(node * 2, lo, mid, w, h, prefer_last, best_space, best_level);
+		search(node * 2 + 1, mid + 1, hi, w, h, prefer_last, best_space, best_level);
+	}
+
+public:
+	explicit level_index(int dsp_w = 0)
+	{
+		reset(dsp_w);
+	}
+
+	//Drops every level, free widths from now on are in [0, dsp_w]
+	void reset(int dsp_w)
+	{
+		max_free = std::max(dsp_w, 0);
+		capacity = 1;
+		while (capacity <= max_free)
+			capacity *= 2;
+		max_height.assign(capacity * 2, -1);
+		min_space.assign(capacity * 2, INT_MAX);
+		buckets.resize(capacity);
+		for (auto& b : buckets)
+		{
+			b.height.clear(); b.space.clear(); b.level.clear();
+		}
+		free_w.clear(); bucket_pos.clear();
+	}
+
+	int size() const
+	{
+		return free_w.size();
+	}
+
+	void push_back(int height, int free, int space)
+	{
+		free_w.push_back(std::clamp(free, 0, max_free));
+		bucket_pos.push_back(0);
+		insert(free_w.size() - 1, height, space);
+		merge_leaf(free_w.back(), height, space);
+	}
+
+	void update(int level, int free, int space)
+	{
+		int old_free = free_w[level];
+		int height = erase(level);
+		free_w[level] = std::clamp(free, 0, max_free);
+		insert(level, height, space);
+		refresh_leaf(old_free);
+		if (old_free != free_w[level])
+			merge_leaf(free_w[level], height, space);
+	}
+
+	//Level with the least space left among those that can hold w x h, -1 if there is none.
+	//On equal space the lowest level number wins, or the highest one when prefer_last is set
+	int find_best(int w, int h, bool prefer_last, int& space) const
+	{
+		int best_level = -1;
+		space = INT_MAX;
+		if ((w <= max_free) && !free_w.empty())
+			search(1, 0, capacity - 1, std::max(w, 0), h, prefer_last, space, best_level);
+		return best_level;
+	}
+};
@@ -0,0 +1,220 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <stdexcept>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+//Read-only view of a whole file mapped into memory, the pages are read in by the OS as the parser walks them
+class mapped_file
+{
+private:
+	const char* data = nullptr;
+	size_t size = 0;
+#ifdef _WIN32
+	HANDLE file = INVALID_HANDLE_VALUE;
+	HANDLE mapping = nullptr;
+#else
+	int fd = -1;
+#endif
+
+public:
+	explicit mapped_file(const std::string& path)
+	{
+#ifdef _WIN32
+		file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+			throw std::runtime_error("Can't open " + path);
+		LARGE_INTEGER file_size;
+		GetFileSizeEx(file, &file_size);
+		size = (size_t)file_size.QuadPart;
+		//an empty file can't be mapped, it is just an empty view
+		if (size == 0)
+			return;
+		mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (mapping)
+			data = (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		if (!data)
+		{
+			if (mapping) CloseHandle(mapping);
+			CloseHandle(file);
+			throw std::runtime_error("Can't map " + path);
+		}
+#else
+		fd = open(path.c_str(), O_RDONLY);
+		if (fd == -1)
+			throw std::runtime_error("Can't open " + path);
+		struct stat st;
+		if (fstat(fd, &st) == 0)
+			size = (size_t)st.st_size;
+		if (size == 0)
+			return;
+		void* p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (p == MAP_FAILED)
+		{
+			close(fd);
+			throw std::runtime_error("Can't map " + path);
+		}
+		madvise(p, size, MADV_SEQUENTIAL);
+		data = (const char*)p;
+#endif
+	}
+
+	~mapped_file()
+	{
+#ifdef _WIN32
+		if (data) UnmapViewOfFile(data);
+		if (mapping) CloseHandle(mapping);
+		if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+#else
+		if (data) munmap((void*)data, size);
+		if (fd != -1) close(fd);
+#endif
+	}
+
+	mapped_file(const mapped_file&) = delete;
+	mapped_file& operator=(const mapped_file&) = delete;
+
+	std::string_view text() const
+	{
+		return { data, data ? size : 0 };
+	}
+};
+
+//Read-write mapping of a file that can grow, changes go to the file itself.
+//A resize moves the mapping, pointers into data() don't survive it
+class writable_mapping
+{
+private:
+	char* ptr = nullptr;
+	size_t size = 0;
+#ifdef _WIN32
+	HANDLE file = INVALID_HANDLE_VALUE;
+	HANDLE mapping = nullptr;
+#else
+	int fd = -1;
+#endif
+
+	void unmap()
+	{
+#ifdef _WIN32
+		if (ptr) UnmapViewOfFile(ptr);
+		if (mapping) CloseHandle(mapping);
+		mapping = nullptr;
+#else
+		if (ptr) munmap(ptr, size);
+#endif
+		ptr = nullptr;
+	}
+
+	void map()
+	{
+		if (size == 0)
+			return;
+#ifdef _WIN32
+		mapping = CreateFileMappingA(file, nullptr, PAGE_READWRITE, 0, 0, nullptr);
+		if (mapping)
+			ptr = (char*)MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, 0);
+#else
+		void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		ptr = (p == MAP_FAILED) ? nullptr : (char*)p;
+#endif
+		if (!ptr)
+			throw std::runtime_error("Can't map file for writing");
+	}
+
+public:
+	//Opens path, creating an empty file if there is none
+	explicit writable_mapping(const std::string& path)
+	{
+#ifdef _WIN32
+		file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+			throw std::runtime_error("Can't open " + path);
+		LARGE_INTEGER file_size;
+		GetFileSizeEx(file, &file_size);
+		size = (size_t)file_size.QuadPart;
+#else
+		fd = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+		if (fd == -1)
+			throw std::runtime_error("Can't open " + path);
+		struct stat st;
+		if (fstat(fd, &st) == 0)
+			size = (size_t)st.st_size;
+#endif
+		try
+		{
+			map();
+		}
+		catch (...)
+		{
+			unmap();
+#ifdef _WIN32
+			CloseHandle(file);
+#else
+			close(fd);
+#endif
+			throw;
+		}
+	}
+
+	~writable_mapping()
+	{
+		unmap();
+#ifdef _WIN32
+		if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+#else
+		if (fd != -1) close(fd);
+#endif
+	}
+
+	writable_mapping(const writable_mapping&) = delete;
+	writable_mapping& operator=(const writable_mapping&) = delete;
+
+	//Grows or shrinks the file to new_size bytes, new bytes are zero
+	void resize(size_t new_size)
+	{
+		unmap();
+#ifdef _WIN32
+		LARGE_INTEGER pos;
+		pos.QuadPart = (LONGLONG)new_size;
+		bool ok = SetFilePointerEx(file, pos, nullptr, FILE_BEGIN) && SetEndOfFile(file);
+#else
+		bool ok = ftruncate(fd, (off_t)new_size) == 0;
+#endif
+		if (!ok)
+			throw std::runtime_error("Can't resize mapped file");
+		size = new_size;
+		map();
+	}
+
+	//Writes dirty pages out now instead of whenever the OS gets to it
+	void flush()
+	{
+		if (!ptr) return;
+#ifdef _WIN32
+		FlushViewOfFile(ptr, 0);
+		FlushFileBuffers(file);
+#else
+		msync(ptr, size, MS_SYNC);
+#endif
+	}
+
+	char* data() const
+	{
+		return ptr;
+	}
+
+	size_t length() const
+	{
+		return size;
+	}
+};
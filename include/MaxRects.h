@@ -0,0 +1,275 @@
+#pragma once
+#include <vector>
+#include <algorithm>
+#include <iterator>
+#include <utility>
+#include <climits>
+
+struct free_rect
+{
+	int x = 0;
+	int y = 0;
+	int w = 0;
+	int h = 0;
+
+	bool contains(const free_rect& r) const
+	{
+		return (r.x >= x) && (r.y >= y) && (r.x + r.w <= x + w) && (r.y + r.h <= y + h);
+	}
+};
+
+//One dsp list for the MaxRects packer.
+//Keeps every maximal free rectangle, a placed rectangle splits only the free rectangles it touches
+//and the new pieces are checked for containment against the rest, so a placement costs O(F * new)
+//instead of a full rescan. A frontier of free rectangle sizes answers "does w x h fit" in O(log F).
+class maxrects_sheet
+{
+private:
+	std::vector<free_rect> free_rects;
+	std::vector<free_rect> pieces;
+
+	//Free rectangle sizes nobody else dominates, widest first and so lowest first:
+	//w x h fits somewhere iff the last entry at least w wide is at least h high
+	std::vector<std::pair<int, int>> frontier;
+
+	void refresh_frontier()
+	{
+		frontier.clear();
+		for (auto& f : free_rects)
+			frontier.push_back({ f.w, f.h });
+		std::sort(frontier.begin(), frontier.end(), [](auto& a, auto& b) { return (a.first > b.first) || ((a.first == b.first) && (a.second > b.second)); });
+		size_t kept = 0;
+		for (auto& f : frontier)
+		{
+			if ((kept == 0) || (f.second > frontier[kept - 1].second))
+				frontier[kept++] = f;
+		}
+		frontier.resize(kept);
+	}
+
+public:
+	maxrects_sheet(int width, int height)
+	{
+		free_rects.push_back({ 0, 0, width, height });
+		refresh_frontier();
+	}
+
+	bool can_fit(int w, int h) const
+	{
+		auto it = std::partition_point(frontier.begin(), frontier.end(), [w](auto& f) { return f.first >= w; });
+		return (it != frontier.begin()) && (std::prev(it)->second >= h);
+	}
+
+	//Best short side fit: the free rectangle where the smaller leftover side is the smallest,
+	//then the larger leftover side. Returns false if w x h fits nowhere on this list
+	bool find(int w, int h, int& short_side, int& long_side, int& x, int& y) const
+	{
+		bool found = false;
+		for (auto& f : free_rects)
+		{
+			if ((w > f.w) || (h > f.h))
+				continue;
+			int dw = f.w - w, dh = f.h - h;
+			int s = std::min(dw, dh), l = std::max(dw, dh);
+			if (!found || (s < short_side) || ((s == short_side) && (l < long_side)))
+			{
+				found = true;
+				short_side = s; long_side = l;
+				x = f.x; y = f.y;
+			}
+		}
+		return found;
+	}
+
+	void place(int x, int y, int w, int h)
+	{
+		free_rect used{ x, y, w, h };
+		pieces.clear();
+		for (size_t i = 0; i < free_rects.size();)
+		{
+			free_rect f = free_rects[i];
+			if ((used.x >= f.x + f.w) || (used.x + used.w <= f.x) || (used.y >= f.y + f.h) || (used.y + used.h <= f.y))
+			{
+				++i;
+				continue;
+			}
+			if (used.x > f.x)
+				pieces.push_back({ f.x, f.y, used.x - f.x, f.h });
+			if (used.x + used.w < f.x + f.w)
+				pieces.push_back({ used.x + used.w, f.y, f.x + f.w - used.x - used.w, f.h });
+			if (used.y > f.y)
+				pieces.push_back({ f.x, f.y, f.w, used.y - f.y });
+			if (used.y + used.h < f.y + f.h)
+				pieces.push_back({ f.x, used.y + used.h, f.w, f.y + f.h - used.y - used.h });
+			free_rects[i] = free_rects.back();
+			free_rects.pop_back();
+		}
+		//Untouched free rectangles never contain each other, so only the new pieces need pruning
+		for (size_t i = 0; i < pieces.size(); ++i)
+		{
+			bool contained = false;
+			for (size_t j = 0; j < pieces.size() && !contained; ++j)
+				contained = (i != j) && pieces[j].contains(pieces[i]) && ((j < i) || !pieces[i].contains(pieces[j]));
+			for (size_t j = 0; j < free_rects.size() && !contained; ++j)
+				contained = free_rects[j].contains(pieces[i]);
+			if (!contained)
+				free_rects.push_back(pieces[i]);
+		}
+		refresh_frontier();
+	}
+
+	//Sizes of the free rectangles no other free rectangle dominates, widest first
+	const std::vector<std::pair<int, int>>& free_sizes() const
+	{
+		return frontier;
+	}
+
+	//True when no free rectangle is at least side x side, nothing left to pack fits here anymore
+	bool is_closed(int side) const
+	{
+		return !can_fit(side, side);
+	}
+};
+
+//Free sizes of a group of lists as a staircase of at most 8 steps, widest first.
+//Merging two neighbour steps keeps the wider width and the higher height, so the staircase
+//never says no to a size that fits somewhere in the group, it may only say yes too often
+struct free_staircase
+{
+	static const int max_steps = 8;
+	int steps = 0;
+	int w[max_steps * 2];
+	int h[max_steps * 2];
+
+	bool can_fit(int rw, int rh) const
+	{
+		for (int i = 0; i < steps; ++i)
+		{
+			if ((w[i] >= rw) && (h[i] >= rh))
+				return true;
+		}
+		return false;
+	}
+
+	//Takes steps sorted by width descending, drops the dominated ones and merges down to max_steps
+	void build(std::pair<int, int>* points, int n)
+	{
+		steps = 0;
+		for (int i = 0; i < n; ++i)
+		{
+			if ((steps == 0) || (points[i].second > h[steps - 1]))
+			{
+				w[steps] = points[i].first;
+				h[steps] = points[i].second;
+				steps++;
+				if (steps == max_steps * 2)
+					compress(max_steps * 2 - 1);
+			}
+		}
+		compress(max_steps);
+	}
+
+	void compress(int limit)
+	{
+		while (steps > limit)
+		{
+			int best = 0;
+			long long best_cost = LLONG_MAX;
+			for (int i = 0; i + 1 < steps; ++i)
+			{
+				long long cost = (long long)(w[i] - w[i + 1]) * (h[i + 1] - h[i]);
+				if (cost < best_cost)
+				{
+					best_cost = cost;
+					best = i;
+				}
+			}
+			h[best] = h[best + 1];
+			for (int i = best + 1; i + 1 < steps; ++i)
+			{
+				w[i] = w[i + 1];
+				h[i] = h[i + 1];
+			}
+			steps--;
+		}
+	}
+};
+
+//First open list that can hold a rectangle, in either orientation if it may turn.
+//Segment tree over list numbers, every node keeps a free_staircase of the lists below it,
+//a closed list drops out with an empty one. Leaves that pass are confirmed with maxrects_sheet::can_fit
+class sheet_index
+{
+private:
+	int capacity = 0;
+	int count = 0;
+	std::vector<free_staircase> nodes;
+	std::vector<std::pair<int, int>> points;
+
+	void pull(int node)
+	{
+		const free_staircase& l = nodes[node * 2];
+		const free_staircase& r = nodes[node * 2 + 1];
+		points.clear();
+		for (int i = 0; i < l.steps; ++i) points.push_back({ l.w[i], l.h[i] });
+		for (int i = 0; i < r.steps; ++i) points.push_back({ r.w[i], r.h[i] });
+		std::sort(points.begin(), points.end(), [](auto& a, auto& b) { return (a.first > b.first) || ((a.first == b.first) && (a.second > b.second)); });
+		nodes[node].build(points.data(), points.size());
+	}
+
+	void grow()
+	{
+		int new_capacity = capacity ? capacity * 2 : 16;
+		std::vector<free_staircase> grown(new_capacity * 2);
+		for (int k = 0; k < count; ++k)
+			grown[new_capacity + k] = nodes[capacity + k];
+		nodes.swap(grown);
+		capacity = new_capacity;
+		for (int node = capacity - 1; node > 0; --node)
+			pull(node);
+	}
+
+	int search(int node, int w, int h, bool rotatable, const std::vector<maxrects_sheet>& sheets) const
+	{
+		if (!nodes[node].can_fit(w, h) && !(rotatable && nodes[node].can_fit(h, w)))
+			return -1;
+		if (node >= capacity)
+		{
+			const maxrects_sheet& sheet = sheets[node - capacity];
+			return (sheet.can_fit(w, h) || (rotatable && sheet.can_fit(h, w))) ? node - capacity : -1;
+		}
+		int k = search(node * 2, w, h, rotatable, sheets);
+		return (k != -1) ? k : search(node * 2 + 1, w, h, rotatable, sheets);
+	}
+
+public:
+	void push_back(const maxrects_sheet& sheet)
+	{
+		if (count == capacity)
+			grow();
+		count++;
+		update(count - 1, sheet);
+	}
+
+	void update(int k, const maxrects_sheet& sheet)
+	{
+		int node = capacity + k;
+		points.assign(sheet.free_sizes().begin(), sheet.free_sizes().end());
+		nodes[node].build(points.data(), points.size());
+		for (node /= 2; node > 0; node /= 2)
+			pull(node);
+	}
+
+	void close(int k)
+	{
+		int node = capacity + k;
+		nodes[node].steps = 0;
+		for (node /= 2; node > 0; node /= 2)
+			pull(node);
+	}
+
+	int find_first(int w, int h, bool rotatable, const std::vector<maxrects_sheet>& sheets) const
+	{
+		return count ? search(1, w, h, rotatable, sheets) : -1;
+	}
+};
@@ -0,0 +1,144 @@
+#pragma once
+#include "Algorythm.h"
+#include <functional>
+#include <mutex>
+#include <cmath>
+
+//Called with (total_count, percentage, last_free) for the logic_part plan and then every time a better plan
+//replaces the best one: one with fewer sheets or, at the same count, one that leaves more of the last list
+//free. percentage only changes with the sheet count, last_free is the part of the last list's height left
+typedef function<void(int, double, double)> progress_callback;
+
+//Simulated annealing over the order and the turn of every part, BF_in_order decodes a candidate into a plan.
+//Starts from the logic_part plan, so the result is never worse than it. Every pool thread runs its own
+//chain until budget runs out or a plan reaches the lower bound. A candidate is scored by the top of its last level, which falls with
+//the sheet count and also rewards emptying the last list, so chains can work towards saving a sheet.
+//With moves set the run is reproducible: budget is ignored, reproducible_chains chains make moves moves
+//each and only stop early on their own, so a seed gives the same plan on every machine and thread count
+const size_t reproducible_chains = 4;
+void optimize_part(span<const Rectangle> data, int dsp_w, int dsp_h, int saw_width, chrono::milliseconds budget, int& min_total, double& max_percent, vector <Rectangle>& best, pack_context& ctx, const progress_callback& progress = nullptr, unsigned int seed = 1, size_t moves = 0)
+{
+	auto deadline = chrono::steady_clock::now() + budget;
+	logic_part(data, dsp_w, dsp_h, saw_width, min_total, max_percent, best, ctx);
+	//the logic_part plan is what a chain has to beat, its levels are still in the winner's scratch
+	long long best_top = ctx.winner < ctx.scratch.size() ? ctx.scratch[ctx.winner].levels.top() : 0;
+	auto last_free = [&](int count, long long top) { return (double)((long long)count * (dsp_h + saw_width) - top) / (dsp_h + saw_width); };
+	if (progress) progress(min_total, max_percent, last_free(min_total, best_top));
+	//nothing can beat a plan on the lower bound
+	if ((data.size() < 2) || (min_total <= ctx.sheet_bound)) return;
+	int list_w = dsp_w + saw_width, list_h = dsp_h + saw_width;
+
+	mutex best_mutex;
+	atomic<bool> optimal{ false };
+	size_t best_chain = SIZE_MAX;
+	worker_pool& pool = ctx.pool ? *ctx.pool : worker_pool::shared();
+	size_t chains = moves ? reproducible_chains : pool.size();
+	//chains skip the scratch of the winning strategy, its levels are what plan_leftovers reads
+	ctx.reserve(max(chains + 1, ctx.winner + 1));
+	auto slot = [&](size_t c) { return c < ctx.winner ? c : c + 1; };
+	//best is in logic_part order and turn, every chain starts from it
+	vector <Rectangle> start = best;
+	pool.run(chains, [&](size_t c)
+	{
+		vector <Rectangle>& work = ctx.work[slot(c)];
+		pack_scratch& scratch = ctx.scratch[slot(c)];
+		mt19937 gen(seed + c * 7919);
+		int n = start.size();
+		uniform_int_distribution<int> pick(0, n - 1);
+		uniform_int_distribution<int> step(-16, 16);
+		uniform_real_distribution<double> unit(0, 1);
+
+		work.assign(start.begin(), start.end());
+		int count = 0;
+		double percentage = 0;
+		BF_in_order(work, list_w, list_h, count, percentage, false, scratch);
+		long long cost = scratch.levels.top(), chain_best = cost;
+
+		//Worsening by a typical part height is taken often at first and almost never at the end
+		long long total_h = 0;
+		for (auto& r : work) total_h += r.height;
+		double t0 = (double)total_h / n, t1 = t0 / 100;
+		auto begin = chrono::steady_clock::now();
+		double span_ms = chrono::duration<double, milli>(deadline - begin).count();
+
+		bool chain_optimal = false;
+		for (size_t k = 0;; ++k)
+		{
+			double progress_part;
+			if (moves)
+			{
+				if ((k >= moves) || chain_optimal) break;
+				progress_part = (double)k / moves;
+			}
+			else
+			{
+				auto now = chrono::steady_clock::now();
+				if ((now >= deadline) || optimal) break;
+				progress_part = chrono::duration<double, milli>(now - begin).count() / span_ms;
+			}
+			double t = t0 * pow(t1 / t0, progress_part);
+
+			//Move: swap with a near part, move a part to a random place, or turn a part
+			int move = gen() % 10, i = pick(gen), j = i;
+			if (move < 5)
+			{
+				j = min(max(i + step(gen), 0), n - 1);
+				swap(work[i], work[j]);
+			}
+			else if (move < 8)
+			{
+				j = pick(gen);
+				if (i < j) rotate(work.begin() + i, work.begin() + i + 1, work.begin() + j + 1);
+				else rotate(work.begin() + j, work.begin() + i, work.begin() + i + 1);
+			}
+			else
+			{
+				if (!work[i].is_rotatable() || (work[i].height > list_w) || (work[i].width > list_h)) continue;
+				work[i].rotate();
+			}
+
+			int new_count = 0;
+			double new_percentage = 0;
+			BF_in_order(work, list_w, list_h, new_count, new_percentage, false, scratch);
+			long long new_cost = scratch.levels.top();
+			if ((new_cost <= cost) || (unit(gen) < exp((cost - new_cost) / t)))
+			{
+				cost = new_cost;
+				if (new_cost < chain_best)
+				{
+					chain_best = new_cost;
+					chain_optimal = new_count <= ctx.sheet_bound;
+					lock_guard<mutex> lock(best_mutex);
+					//ties go to the lower chain, so the winner doesn't depend on which chain got here first
+					if (make_tuple(new_count, new_cost, c) < make_tuple(min_total, best_top, best_chain))
+					{
+						best_top = new_cost;
+						best_chain = c;
+						min_total = new_count; max_percent = new_percentage;
+						best.assign(work.begin(), work.end());
+						optimal = min_total <= ctx.sheet_bound;
+						if (progress) progress(min_total, max_percent, last_free(min_total, best_top));
+					}
+				}
+			}
+			else
+			{
+				//Undo the move
+				if (move < 5) swap(work[i], work[j]);
+				else if (move < 8)
+				{
+					if (i < j) rotate(work.begin() + i, work.begin() + j, work.begin() + j + 1);
+					else rotate(work.begin() + j, work.begin() + j + 1, work.begin() + i + 1);
+				}
+				else work[i].rotate();
+			}
+		}
+	});
+	//a chain beat logic_part, lay its plan out in the winner's scratch so the leftovers match it
+	if (best_chain != SIZE_MAX)
+	{
+		int count = 0;
+		double percentage = 0;
+		BF_in_order(best, list_w, list_h, count, percentage, false, ctx.scratch[ctx.winner]);
+	}
+}
@@ -0,0 +1,346 @@
+#pragma once
+#include "Algorythm.h"
+
+//A shelf plan that stays alive while the order is edited.
+//Parts are kept in the BF frame (saw width added to sizes) with y counted inside their own list.
+//add() drops a part on the shelf where it leaves the least space, opens a shelf on top of a list
+//or starts a new list, remove() repacks only the list the part was on. Nothing else moves until
+//the fill drops below repack_threshold of the last full plan, then everything is planned again
+class pack_session
+{
+private:
+	//Band of one list, parts on it stand on y and are placed left to right up to used_w
+	struct shelf
+	{
+		int y = 0;
+		int height = 0;
+		int used_w = 0;
+	};
+	struct sheet
+	{
+		vector <int> parts;
+		vector <shelf> shelves;
+
+		int top() const
+		{
+			return shelves.empty() ? 0 : shelves.back().y + shelves.back().height;
+		}
+	};
+
+	int dsp_w, dsp_h, saw_width;
+	int list_w, list_h;
+	double repack_threshold;
+	double full_percentage = 0;
+	int full_repacks = 0;
+
+	vector <Rectangle> given;  //parts as they were given
+	vector <Rectangle> order;  //the same turned to fit the dsp by fit_part_to_dsp, real sizes
+	vector <Rectangle> placed; //parts in the plan, indexed by id
+	vector <bool> alive;
+	vector <sheet> sheets;
+	long long used_area = 0;
+
+	pack_context ctx;
+	vector <Rectangle> work, best;
+
+	//Shelves of a list as BF left them: parts standing on the same y share a shelf
+	//that reaches up to the next one, the last shelf is as high as its highest part
+	void rebuild_shelves(sheet& s)
+	{
+		sort(s.parts.begin(), s.parts.end(), [&](int a, int b) { return (placed[a].y < placed[b].y) || ((placed[a].y == placed[b].y) && (placed[a].x < placed[b].x)); });
+		s.shelves.clear();
+		for (int id : s.parts)
+		{
+			const Rectangle& r = placed[id];
+			if (s.shelves.empty() || (s.shelves.back().y != r.y))
+			{
+				if (!s.shelves.empty())
+					s.shelves.back().height = r.y - s.shelves.back().y;
+				s.shelves.push_back({ (int)r.y, 0, 0 });
+			}
+			shelf& sh = s.shelves.back();
+			sh.height = max<int>(sh.height, r.height);
+			sh.used_w = max<int>(sh.used_w, r.x + r.width);
+		}
+	}
+
+	//Packs what is left on list k again with every strategy, keeps the one with the lowest top.
+	//If no strategy gets the parts on one list the old layout stays, it is still valid
+	void repair_sheet(int k)
+	{
+		sheet& s = sheets[k];
+		if (s.parts.empty())
+		{
+			drop_sheet(k);
+			return;
+		}
+		int best_top = INT_MAX;
+		for (auto& st : default_strategies())
+		{
+			work.clear();
+			for (int id : s.parts)
+				work.push_back(placed[id]);
+			if (st.landscape)
+			{
+				for (auto& r : work)
+				{
+					if (r.height > r.width)
+						r.rotate();
+				}
+			}
+			int count = 0;
+			double percentage = 0;
+			BF(work, list_w, list_h, count, percentage, st.rotate, ctx.scratch[0], st.key);
+			int top = ctx.scratch[0].levels.top();
+			if ((count == 1) && (top < best_top))
+			{
+				best_top = top;
+				best.assign(work.begin(), work.end());
+			}
+		}
+		if (best_top == INT_MAX)
+			return;
+		for (auto& r : best)
+		{
+			r.dspN = k;
+			placed[r.id] = r;
+		}
+		rebuild_shelves(s);
+	}
+
+	void drop_sheet(int k)
+	{
+		sheets.erase(sheets.begin() + k);
+		for (int i = k; i < sheets.size(); ++i)
+		{
+			for (int id : sheets[i].parts)
+				placed[id].dspN = i;
+		}
+	}
+
+	//Best of the shelves on every list for r as it is turned now, leftover is the space the shelf keeps
+	bool find_shelf(const Rectangle& r, int& best_sheet, int& best_shelf, long long& leftover) const
+	{
+		bool found = false;
+		for (int k = 0; k < sheets.size(); ++k)
+		{
+			for (int i = 0; i < sheets[k].shelves.size(); ++i)
+			{
+				const shelf& sh = sheets[k].shelves[i];
+				if ((r.height > sh.height) || (sh.used_w + r.width > list_w))
+					continue;
+				long long left = (long long)sh.height * (list_w - sh.used_w) - (long long)r.width * r.height;
+				if (!found || (left < leftover))
+				{
+					found = true;
+					leftover = left;
+					best_sheet = k; best_shelf = i;
+				}
+			}
+		}
+		return found;
+	}
+
+	void place(int id)
+	{
+		Rectangle& r = placed[id];
+		int k = -1, i = -1;
+		long long leftover = 0;
+		bool found = find_shelf(r, k, i, leftover);
+		if (r.is_rotatable())
+		{
+			r.rotate();
+			int rk = -1, ri = -1;
+			long long rotated_leftover = 0;
+			if (find_shelf(r, rk, ri, rotated_leftover) && (!found || (rotated_leftover < leftover)))
+			{
+				found = true;
+				k = rk; i = ri;
+			}
+			else
+				r.rotate();
+		}
+		if (!found)
+		{
+			//New shelf: lying parts make lower shelves, it goes to the list with the least room left above
+			if (r.is_rotatable() && (r.height > r.width) && (r.height <= list_w))
+				r.rotate();
+			int room = INT_MAX;
+			for (int s = 0; s < sheets.size(); ++s)
+			{
+				int left = list_h - sheets[s].top() - (int)r.height;
+				if ((left >= 0) && (left < room))
+				{
+					room = left;
+					k = s;
+				}
+			}
+			if (k == -1)
+			{
+				k = sheets.size();
+				sheets.emplace_back();
+			}
+			sheets[k].shelves.push_back({ sheets[k].top(), (int)r.height, 0 });
+			i = sheets[k].shelves.size() - 1;
+		}
+		shelf& sh = sheets[k].shelves[i];
+		r.x = sh.used_w;
+		r.y = sh.y;
+		r.dspN = k;
+		sh.used_w += r.width;
+		sheets[k].parts.push_back(id);
+	}
+
+	void unplace(int id)
+	{
+		auto& parts = sheets[placed[id].dspN].parts;
+		parts.erase(find(parts.begin(), parts.end(), id));
+	}
+
+	void check_yield()
+	{
+		if (!sheets.empty() && (percentage() < full_percentage * repack_threshold))
+			repack();
+	}
+
+public:
+	//repack_threshold is the part of the last full plan's fill the session may lose before planning again
+	pack_session(int dsp_w, int dsp_h, int saw_width = 10, double repack_threshold = 0.95)
+		: dsp_w(dsp_w), dsp_h(dsp_h), saw_width(saw_width), list_w(dsp_w + saw_width), list_h(dsp_h + saw_width), repack_threshold(repack_threshold)
+	{
+		ctx.reserve(1);
+	}
+
+	//Starts over with a new order, ids are positions in it
+	void assign(span<const Rectangle> parts)
+	{
+		given.assign(parts.begin(), parts.end());
+		order.clear();
+		for (int i = 0; i < given.size(); ++i)
+		{
+			given[i].id = i;
+			order.push_back(given[i]);
+			fit_part_to_dsp(order[i], dsp_w, dsp_h);
+		}
+		alive.assign(order.size(), true);
+		repack();
+	}
+
+	//Plans every part from scratch with logic_part
+	void repack()
+	{
+		work.clear();
+		used_area = 0;
+		for (int i = 0; i < order.size(); ++i)
+		{
+			if (alive[i])
+				work.push_back(order[i]);
+		}
+		placed.assign(order.begin(), order.end());
+		sheets.clear();
+		full_repacks++;
+		if (work.empty())
+			return;
+		int total_count = 0;
+		logic_part(work, dsp_w, dsp_h, saw_width, total_count, full_percentage, best, ctx);
+		sheets.resize(total_count);
+		for (auto& r : best)
+		{
+			r.dspN = r.y / list_h;
+			r.y -= r.dspN * list_h;
+			used_area += (long long)r.width * r.height;
+			placed[r.id] = r;
+			sheets[r.dspN].parts.push_back(r.id);
+		}
+		//a list BF left empty is not worth keeping
+		for (int k = sheets.size() - 1; k >= 0; --k)
+		{
+			if (sheets[k].parts.empty())
+				drop_sheet(k);
+		}
+		for (auto& s : sheets)
+			rebuild_shelves(s);
+	}
+
+	int add(Rectangle r)
+	{
+		int id = order.size();
+		r.id = id;
+		Rectangle as_given = r;
+		fit_part_to_dsp(r, dsp_w, dsp_h);
+		given.push_back(as_given);
+		order.push_back(r);
+		alive.push_back(true);
+		r.width += saw_width;
+		r.height += saw_width;
+		placed.push_back(r);
+		used_area += (long long)r.width * r.height;
+		place(id);
+		check_yield();
+		return id;
+	}
+
+	void remove(int id)
+	{
+		if ((id < 0) || (id >= order.size()) || !alive[id])
+			throw "No such part in the session";
+		alive[id] = false;
+		used_area -= (long long)placed[id].width * placed[id].height;
+		int k = placed[id].dspN;
+		unplace(id);
+		repair_sheet(k);
+		check_yield();
+	}
+
+	//The part keeps its id, bands and grain, its old list is repacked and the new size is placed like
+	//an added part. width and height are in the frame the part was given in, not the one it was turned to
+	void resize(int id, unsigned int width, unsigned int height)
+	{
+		if ((id < 0) || (id >= order.size()) || !alive[id])
+			throw "No such part in the session";
+		Rectangle r = given[id];
+		r.width = width;
+		r.height = height;
+		fit_part_to_dsp(r, dsp_w, dsp_h);
+		given[id].width = width;
+		given[id].height = height;
+		order[id] = r;
+		used_area -= (long long)placed[id].width * placed[id].height;
+		int k = placed[id].dspN;
+		unplace(id);
+		r.width += saw_width;
+		r.height += saw_width;
+		placed[id] = r;
+		used_area += (long long)r.width * r.height;
+		place(id);
+		repair_sheet(k);
+		check_yield();
+	}
+
+	int sheet_count() const
+	{
+		return sheets.size();
+	}
+
+	double percentage() const
+	{
+		return sheets.empty() ? 0 : ((double)used_area / list_w) / ((double)list_h * sheets.size());
+	}
+
+	int repack_count() const
+	{
+		return full_repacks;
+	}
+
+	//The plan in algorythm() form: saw width added to sizes, dspN set and y counted inside the list
+	vector <Rectangle> plan() const
+	{
+		vector <Rectangle> result;
+		for (auto& s : sheets)
+		{
+			for (int id : s.parts)
+				result.push_back(placed[id]);
+		}
+		return result;
+	}
+};
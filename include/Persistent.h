@@ -0,0 +1,198 @@
+#if !defined(PERSISTENT_HH)
+#define PERSISTENT_HH
+
+#include <memory>
+#include <vector>
+#include <cstddef>
+#include <algorithm>
+
+//Array kept as a 16-way trie of shared nodes. Copying one is O(1) and the copies share every node,
+//a write first copies the nodes on its path that another copy still uses. So a copy taken before an
+//edit keeps the old contents and costs only the nodes the edit touched
+template <class T>
+class PersistentArray
+{
+private:
+    static const int BITS = 4;
+    static const size_t WIDTH = 1 << BITS;
+    static const size_t MASK = WIDTH - 1;
+
+    //inner nodes use kids, leaves use values. kids is a plain array so a read down the trie
+    //doesn't go through a vector on every level
+    struct Node
+    {
+        std::shared_ptr<Node> kids[WIDTH];
+        size_t used = 0;
+        std::vector<T> values;
+    };
+
+    std::shared_ptr<Node> root;
+    size_t count = 0;
+    int shift = 0;
+
+    //The node is about to be written, take a copy of our own if another version still holds it.
+    //Copies are only as big as what they hold, that is all an edit costs
+    static Node *own(std::shared_ptr<Node> &node)
+    {
+        if (node.use_count() > 1)
+            node = std::make_shared<Node>(*node);
+        return node.get();
+    }
+
+public:
+    size_t size() const
+    {
+        return count;
+    }
+
+    const T &operator[](size_t i) const
+    {
+        const Node *node = root.get();
+        for (int level = shift; level > 0; level -= BITS)
+            node = node->kids[(i >> level) & MASK].get();
+        return node->values[i & MASK];
+    }
+
+    //Writable element, valid until the array is copied or changed again
+    T &mut(size_t i)
+    {
+        Node *node = own(root);
+        for (int level = shift; level > 0; level -= BITS)
+            node = own(node->kids[(i >> level) & MASK]);
+        return node->values[i & MASK];
+    }
+
+    void push_back(const T &value)
+    {
+        if (!root)
+            root = std::make_shared<Node>();
+        if (count == (WIDTH << shift))
+        {
+            auto top = std::make_shared<Node>();
+            top->kids[top->used++] = root;
+            root = top;
+            shift += BITS;
+        }
+        Node *node = own(root);
+        for (int level = shift; level > 0; level -= BITS)
+        {
+            size_t k = (count >> level) & MASK;
+            if (k == node->used)
+                node->kids[node->used++] = std::make_shared<Node>();
+            node = own(node->kids[k]);
+        }
+        node->values.push_back(value);
+        count++;
+    }
+
+    void clear()
+    {
+        root.reset();
+        count = 0;
+        shift = 0;
+    }
+
+    //Calls f(i) for every index whose element may differ between this array and other: the ones in
+    //nodes the two don't share and the ones only one of them has. Shared nodes are skipped whole,
+    //so comparing two versions costs what the edits between them touched
+    template <class F>
+    void diff(const PersistentArray &other, F f) const
+    {
+        size_t common = std::min(count, other.count);
+        if (shift == other.shift)
+            diffNode(root.get(), other.root.get(), shift, 0, common, f);
+        else
+            for (size_t i = 0; i < common; ++i)
+                f(i);
+        for (size_t i = common; i < std::max(count, other.count); ++i)
+            f(i);
+    }
+
+private:
+    template <class F>
+    static void diffNode(const Node *a, const Node *b, int level, size_t base, size_t limit, F &f)
+    {
+        if (a == b || base >= limit)
+            return;
+        if (!a || !b || level == 0)
+        {
+            for (size_t i = base; i < std::min(limit, base + (WIDTH << level)); ++i)
+                f(i);
+            return;
+        }
+        for (size_t k = 0; k < WIDTH; ++k)
+        {
+            const Node *ka = k < a->used ? a->kids[k].get() : nullptr;
+            const Node *kb = k < b->used ? b->kids[k].get() : nullptr;
+            diffNode(ka, kb, level - BITS, base + (k << level), limit, f);
+        }
+    }
+};
+
+//Stack of shared cells, copies share the cells they have in common
+template <class T>
+class PersistentStack
+{
+private:
+    struct Cell
+    {
+        T value;
+        std::shared_ptr<const Cell> next;
+    };
+
+    std::shared_ptr<const Cell> head;
+    size_t count = 0;
+
+public:
+    PersistentStack() = default;
+    PersistentStack(const PersistentStack &) = default;
+    PersistentStack(PersistentStack &&) = default;
+    PersistentStack &operator=(const PersistentStack &) = default;
+    PersistentStack &operator=(PersistentStack &&) = default;
+
+    ~PersistentStack()
+    {
+        clear();
+    }
+
+    bool empty() const
+    {
+        return !head;
+    }
+
+    size_t size() const
+    {
+        return count;
+    }
+
+    const T &top() const
+    {
+        return head->value;
+    }
+
+    void push(const T &value)
+    {
+        head = std::make_shared<const Cell>(Cell{value, head});
+        count++;
+    }
+
+    void pop()
+    {
+        head = head->next;
+        count--;
+    }
+
+    //Cells nobody else holds are let go one by one, a long chain would overflow the stack otherwise
+    void clear()
+    {
+        while (head && head.use_count() == 1)
+        {
+            std::shared_ptr<const Cell> next = head->next;
+            head = std::move(next);
+        }
+        head.reset();
+        count = 0;
+    }
+};
+
+#endif // PERSISTENT_HH
@@ -0,0 +1,196 @@
+#pragma once
+#include "Algorythm.h"
+#include "../thirdparty/stb_image_write.h"
+#include <mutex>
+
+//Files export_plan writes for every sheet, can be or-ed together
+enum ExportFormat
+{
+    EXPORT_SVG = 1,
+    EXPORT_DXF = 2,
+    EXPORT_PNG = 4,
+};
+
+//Parts of a plan in algorythm() form put in sheet order, sheet s is parts[first[s]..first[s + 1])
+struct sheet_layout
+{
+	vector <Rectangle> parts;
+	vector <int> first;
+
+	int size() const
+	{
+		return first.empty() ? 0 : first.size() - 1;
+	}
+	span<const Rectangle> sheet(int s) const
+	{
+		return span<const Rectangle>(parts).subspan(first[s], first[s + 1] - first[s]);
+	}
+};
+
+//Counting sort of the plan by dspN, parts of a sheet keep their order
+void group_by_sheet(span<const Rectangle> plan, sheet_layout& layout)
+{
+	int sheets = 0;
+	for (auto& r : plan)
+		sheets = max<int>(sheets, r.dspN + 1);
+	layout.first.assign(sheets + 1, 0);
+	for (auto& r : plan)
+		layout.first[r.dspN + 1]++;
+	for (int s = 0; s < sheets; ++s)
+		layout.first[s + 1] += layout.first[s];
+	layout.parts.assign(plan.begin(), plan.end());
+	vector <int> next(layout.first.begin(), layout.first.end() - 1);
+	for (auto& r : plan)
+		layout.parts[next[r.dspN]++] = r;
+}
+
+//Real place and size of a part: the saw width taken off and y turned to count from the top of the sheet,
+//so north is up in every format
+struct part_box
+{
+	int x, y, w, h;
+};
+part_box real_box(const Rectangle& r, int dsp_h, int saw_width)
+{
+	int w = r.width - saw_width, h = r.height - saw_width;
+	return { (int)r.x, dsp_h - (int)r.y - h, w, h };
+}
+
+//One sheet as SVG in mm, banded edges are drawn red, every part is labelled with its id and size
+void write_sheet_svg(ostream& os, span<const Rectangle> parts, int dsp_w, int dsp_h, int saw_width)
+{
+	os << "<svg xmlns=\"http://www.w3.org/2000/svg\" viewBox=\"0 0 " << dsp_w << " " << dsp_h
+		<< "\" width=\"" << dsp_w << "mm\" height=\"" << dsp_h << "mm\">\n";
+	os << "<rect x=\"0\" y=\"0\" width=\"" << dsp_w << "\" height=\"" << dsp_h << "\" fill=\"#eeeeee\" stroke=\"#000000\" stroke-width=\"4\"/>\n";
+	for (auto& r : parts)
+	{
+		part_box b = real_box(r, dsp_h, saw_width);
+		os << "<rect x=\"" << b.x << "\" y=\"" << b.y << "\" width=\"" << b.w << "\" height=\"" << b.h << "\" fill=\"#dcbc8c\" stroke=\"#000000\" stroke-width=\"2\"/>\n";
+		auto band = [&](bool canted, int x1, int y1, int x2, int y2)
+		{
+			if (canted)
+				os << "<line x1=\"" << x1 << "\" y1=\"" << y1 << "\" x2=\"" << x2 << "\" y2=\"" << y2 << "\" stroke=\"#c00000\" stroke-width=\"6\"/>\n";
+		};
+		band(r.north_canted, b.x, b.y, b.x + b.w, b.y);
+		band(r.south_canted, b.x, b.y + b.h, b.x + b.w, b.y + b.h);
+		band(r.west_canted, b.x, b.y, b.x, b.y + b.h);
+		band(r.east_canted, b.x + b.w, b.y, b.x + b.w, b.y + b.h);
+		int font = max(1, min({ b.h / 4, b.w / 8, 60 }));
+		os << "<text x=\"" << b.x + b.w / 2 << "\" y=\"" << b.y + b.h / 2 << "\" font-size=\"" << font
+			<< "\" text-anchor=\"middle\" dominant-baseline=\"middle\">" << r.id << ": " << b.w << "x" << b.h << "</text>\n";
+	}
+	os << "</svg>\n";
+}
+
+//One sheet as an ASCII DXF of lines and texts, in mm with y up. Layers SHEET, PARTS, BANDS and LABELS
+void write_sheet_dxf(ostream& os, span<const Rectangle> parts, int dsp_w, int dsp_h, int saw_width)
+{
+	auto line = [&](const char* layer, int x1, int y1, int x2, int y2)
+	{
+		os << "0\nLINE\n8\n" << layer << "\n10\n" << x1 << "\n20\n" << y1 << "\n11\n" << x2 << "\n21\n" << y2 << "\n";
+	};
+	auto box = [&](const char* layer, int x, int y, int w, int h)
+	{
+		line(layer, x, y, x + w, y);
+		line(layer, x + w, y, x + w, y + h);
+		line(layer, x + w, y + h, x, y + h);
+		line(layer, x, y + h, x, y);
+	};
+	os << "0\nSECTION\n2\nENTITIES\n";
+	box("SHEET", 0, 0, dsp_w, dsp_h);
+	for (auto& r : parts)
+	{
+		int x = r.x, y = r.y, w = r.width - saw_width, h = r.height - saw_width;
+		box("PARTS", x, y, w, h);
+		if (r.north_canted) line("BANDS", x, y + h, x + w, y + h);
+		if (r.south_canted) line("BANDS", x, y, x + w, y);
+		if (r.west_canted) line("BANDS", x, y, x, y + h);
+		if (r.east_canted) line("BANDS", x + w, y, x + w, y + h);
+		int font = max(1, min({ h / 4, w / 8, 60 }));
+		os << "0\nTEXT\n8\nLABELS\n10\n" << x + font / 2 << "\n20\n" << y + h / 2 << "\n40\n" << font << "\n1\n" << r.id << ": " << w << "x" << h << "\n";
+	}
+	os << "0\nENDSEC\n0\nEOF\n";
+}
+
+//One sheet drawn into an RGB image width pixels wide: parts in shades of wood told apart by id,
+//outlines in black and banded edges in red. No labels, the vector files have them
+void rasterize_sheet(span<const Rectangle> parts, int dsp_w, int dsp_h, int saw_width, int width, vector <unsigned char>& rgb, int& height)
+{
+	double scale = (double)width / dsp_w;
+	height = max(1, (int)(dsp_h * scale));
+	rgb.assign((size_t)width * height * 3, 0xee);
+	auto fill = [&](double x0, double y0, double x1, double y1, unsigned char r, unsigned char g, unsigned char b)
+	{
+		int px0 = max(0, (int)(x0 * scale)), py0 = max(0, (int)(y0 * scale));
+		int px1 = min(width, max(px0 + 1, (int)(x1 * scale))), py1 = min(height, max(py0 + 1, (int)(y1 * scale)));
+		for (int py = py0; py < py1; ++py)
+		{
+			unsigned char* p = &rgb[((size_t)py * width + px0) * 3];
+			for (int px = px0; px < px1; ++px, p += 3)
+			{
+				p[0] = r; p[1] = g; p[2] = b;
+			}
+		}
+	};
+	//one pixel in mm, lines are at least that thick
+	double px = 1 / scale;
+	for (auto& r : parts)
+	{
+		part_box b = real_box(r, dsp_h, saw_width);
+		int shade = (r.id * 37) % 48;
+		fill(b.x, b.y, b.x + b.w, b.y + b.h, 220 - shade, 188 - shade, 140 - shade);
+		fill(b.x, b.y, b.x + b.w, b.y + px, 0, 0, 0);
+		fill(b.x, b.y + b.h - px, b.x + b.w, b.y + b.h, 0, 0, 0);
+		fill(b.x, b.y, b.x + px, b.y + b.h, 0, 0, 0);
+		fill(b.x + b.w - px, b.y, b.x + b.w, b.y + b.h, 0, 0, 0);
+		double t = 2 * px;
+		if (r.north_canted) fill(b.x, b.y, b.x + b.w, b.y + t, 192, 0, 0);
+		if (r.south_canted) fill(b.x, b.y + b.h - t, b.x + b.w, b.y + b.h, 192, 0, 0);
+		if (r.west_canted) fill(b.x, b.y, b.x + t, b.y + b.h, 192, 0, 0);
+		if (r.east_canted) fill(b.x + b.w - t, b.y, b.x + b.w, b.y + b.h, 192, 0, 0);
+	}
+}
+
+//Writes dir/stem_<sheet>.svg, .dxf and .png, as formats asks, for every sheet of a plan in algorythm() form.
+//Sheets are done one per task on pool, so the previews are drawn and compressed in parallel.
+//PNG filter and compression level are stb's globals, left to the program to set before any export.
+//Returns the number of sheets, throws if a file can't be written
+int export_plan(span<const Rectangle> plan, int dsp_w, int dsp_h, int saw_width, const string& dir, const string& stem, int formats = EXPORT_SVG | EXPORT_PNG, int preview_width = 800, worker_pool& pool = worker_pool::shared())
+{
+	sheet_layout layout;
+	group_by_sheet(plan, layout);
+	mutex error_mutex;
+	string error;
+	pool.run(layout.size(), [&](size_t s)
+	{
+		string base = dir + "/" + stem + "_" + to_string(s);
+		span<const Rectangle> parts = layout.sheet(s);
+		auto vector_file = [&](const string& path, void (*write)(ostream&, span<const Rectangle>, int, int, int))
+		{
+			ofstream os(path);
+			write(os, parts, dsp_w, dsp_h, saw_width);
+			return (bool)os;
+		};
+		string failed;
+		if ((formats & EXPORT_SVG) && !vector_file(base + ".svg", write_sheet_svg))
+			failed = base + ".svg";
+		if ((formats & EXPORT_DXF) && !vector_file(base + ".dxf", write_sheet_dxf))
+			failed = base + ".dxf";
+		if (formats & EXPORT_PNG)
+		{
+			thread_local vector <unsigned char> rgb;
+			int height = 0;
+			rasterize_sheet(parts, dsp_w, dsp_h, saw_width, preview_width, rgb, height);
+			if (!stbi_write_png((base + ".png").c_str(), preview_width, height, 3, rgb.data(), preview_width * 3))
+				failed = base + ".png";
+		}
+		if (!failed.empty())
+		{
+			lock_guard<mutex> lock(error_mutex);
+			if (error.empty()) error = "Can't write " + failed;
+		}
+	});
+	if (!error.empty())
+		throw runtime_error(error);
+	return layout.size();
+}
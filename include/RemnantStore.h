@@ -0,0 +1,212 @@
+#pragma once
+#include "Stock.h"
+#include "MappedFile.h"
+#include <cstdint>
+#include <cstring>
+
+//Free piece of a plan that is worth keeping, real sizes, sheet is the dsp list it is cut from
+struct leftover
+{
+	int sheet = 0;
+	int x = 0;
+	int y = 0;
+	int width = 0;
+	int height = 0;
+};
+
+//A piece is worth keeping if its short side is at least min_short and its long side at least min_long
+bool is_usable_leftover(int w, int h, int min_short, int min_long)
+{
+	return (min(w, h) >= min_short) && (max(w, h) >= min_long);
+}
+
+//Leftovers of a BF plan, levels in the frame BF ran in. Every level leaves the strip right of its last
+//part, the extra levels at the top of full lists are whole strips, and the last list leaves everything
+//above its last level. The strips are disjoint and each comes off with a cut along a level and a cross cut
+void level_leftovers(const level_table& levels, int dsp_w, int dsp_h, int saw_width, int min_short, int min_long, vector <leftover>& out)
+{
+	int list_h = dsp_h + saw_width;
+	for (int k = 0; k < levels.size(); ++k)
+	{
+		int sheet = levels.cell_h[k] / list_h;
+		int y = levels.cell_h[k] - sheet * list_h;
+		//the saw width in a level height is the kerf under the next level
+		int w = dsp_w - levels.curr_w[k];
+		int h = min(levels.height[k] - saw_width, dsp_h - y);
+		if ((w > 0) && (h > 0) && is_usable_leftover(w, h, min_short, min_long))
+			out.push_back({ sheet, levels.curr_w[k], y, w, h });
+	}
+	if (levels.size() > 0)
+	{
+		int top = levels.top();
+		int sheet = (top - 1) / list_h;
+		int y = top - sheet * list_h;
+		int h = dsp_h - y;
+		if ((h > 0) && is_usable_leftover(dsp_w, h, min_short, min_long))
+			out.push_back({ sheet, 0, y, dsp_w, h });
+	}
+}
+
+//Leftovers of a guillotine plan: the free leaves of the cut trees, already separated by the cuts
+void cut_leftovers(const vector <guillotine_sheet>& sheets, int min_short, int min_long, vector <leftover>& out)
+{
+	for (int s = 0; s < sheets.size(); ++s)
+	{
+		for (auto& n : sheets[s].nodes)
+		{
+			if (n.is_leaf() && (n.part == -1) && (n.w > 0) && (n.h > 0) && is_usable_leftover(n.w, n.h, min_short, min_long))
+				out.push_back({ s, n.x, n.y, n.w, n.h });
+		}
+	}
+}
+
+//Leftovers of the last plan made with ctx. SHELF reads the levels of the winning strategy, GUILLOTINE
+//the cut trees, MAXRECTS keeps no layout state and gives none
+void plan_leftovers(const pack_context& ctx, PackEngine engine, int dsp_w, int dsp_h, int saw_width, int min_short, int min_long, vector <leftover>& out)
+{
+	if (engine == SHELF)
+	{
+		if (ctx.winner < ctx.scratch.size())
+			level_leftovers(ctx.scratch[ctx.winner].levels, dsp_w, dsp_h, saw_width, min_short, min_long, out);
+	}
+	else if (engine == GUILLOTINE)
+		cut_leftovers(ctx.sheets, min_short, min_long, out);
+}
+
+//Remnants kept in a memory-mapped file between runs. The file is a header and an array of records,
+//a taken remnant stays in the file marked as used, so ids never change.
+//Queries go through two stock_index trees, largest first and smallest first, built when the store
+//is opened or after adds and kept up to date by take()
+class remnant_store
+{
+private:
+	struct header
+	{
+		char magic[4];
+		uint32_t version;
+		uint32_t count;
+		uint32_t capacity;
+	};
+	struct record
+	{
+		int32_t width;
+		int32_t height;
+		uint32_t used;
+		uint32_t source;
+	};
+
+	writable_mapping file;
+	vector <stock_sheet> stock; //one entry per record, count 0 once it is used
+	stock_index largest, smallest;
+	bool dirty = true;
+
+	header& head() const
+	{
+		return *(header*)file.data();
+	}
+	record* records() const
+	{
+		return (record*)(file.data() + sizeof(header));
+	}
+
+	void reindex()
+	{
+		if (!dirty) return;
+		largest.build(stock, true, true);
+		smallest.build(stock, true, false);
+		dirty = false;
+	}
+
+public:
+	explicit remnant_store(const string& path) : file(path)
+	{
+		if (file.length() == 0)
+		{
+			file.resize(sizeof(header) + 64 * sizeof(record));
+			header h = { { 'R', 'M', 'N', 'T' }, 1, 0, 64 };
+			memcpy(file.data(), &h, sizeof(h));
+		}
+		if ((file.length() < sizeof(header)) || memcmp(head().magic, "RMNT", 4) || (head().version != 1) ||
+			(file.length() < sizeof(header) + (size_t)head().capacity * sizeof(record)) || (head().count > head().capacity))
+			throw runtime_error(path + " is not a remnant store");
+		for (uint32_t i = 0; i < head().count; ++i)
+			stock.push_back({ records()[i].width, records()[i].height, records()[i].used ? 0 : 1, 0, true });
+	}
+
+	uint32_t size() const
+	{
+		return head().count;
+	}
+
+	int width(uint32_t id) const { return records()[id].width; }
+	int height(uint32_t id) const { return records()[id].height; }
+	bool is_used(uint32_t id) const { return records()[id].used != 0; }
+	//what the remnant was cut from, as given to add()
+	uint32_t source(uint32_t id) const { return records()[id].source; }
+
+	uint32_t add(int w, int h, uint32_t source = 0)
+	{
+		if (head().count == head().capacity)
+		{
+			uint32_t capacity = head().capacity * 2;
+			file.resize(sizeof(header) + (size_t)capacity * sizeof(record));
+			head().capacity = capacity;
+		}
+		uint32_t id = head().count;
+		records()[id] = { w, h, 0, source };
+		head().count = id + 1;
+		stock.push_back({ w, h, 1, 0, true });
+		dirty = true;
+		return id;
+	}
+
+	void add_leftovers(span<const leftover> pieces, uint32_t source = 0)
+	{
+		for (auto& p : pieces)
+			add(p.width, p.height, source);
+	}
+
+	//Marks a remnant as cut up, it is never returned by a query again
+	void take(uint32_t id)
+	{
+		if ((id >= head().count) || records()[id].used)
+			throw runtime_error("Remnant " + to_string(id) + " is not in stock");
+		records()[id].used = 1;
+		stock[id].count = 0;
+		if (!dirty)
+		{
+			largest.close(id);
+			smallest.close(id);
+		}
+	}
+
+	//Id of the largest remnant in stock w x h fits on, -1 if there is none
+	int find_largest(int w, int h, bool rotatable = true)
+	{
+		reindex();
+		return largest.find_first(w, h, rotatable, stock);
+	}
+
+	//Id of the smallest remnant in stock w x h fits on, -1 if there is none
+	int find_smallest(int w, int h, bool rotatable = true)
+	{
+		reindex();
+		return smallest.find_first(w, h, rotatable, stock);
+	}
+
+	//Remnants in stock as stock_part inventory, ids[i] is the remnant entry i stands for
+	void inventory(double cost, vector <stock_sheet>& out, vector <uint32_t>& ids) const
+	{
+		for (uint32_t i = 0; i < stock.size(); ++i)
+		{
+			if (stock[i].count == 0) continue;
+			out.push_back({ stock[i].width, stock[i].height, 1, cost, true });
+			ids.push_back(i);
+		}
+	}
+
+	void flush()
+	{
+		file.flush();
+	}
+};
@@ -0,0 +1,319 @@
+#pragma once
+#include "Algorythm.h"
+#include <numeric>
+
+//A kind of board in stock. count -1 means as many as needed, remnants are offcuts of earlier jobs
+struct stock_sheet
+{
+	int width = 0;
+	int height = 0;
+	int count = -1;
+	double cost = 1;
+	bool remnant = false;
+};
+
+//Stock list: one board kind per line, "width height count cost", count -1 for as many as needed,
+//cost in whole units of money, cents say
+void parse_stock(string_view text, vector <stock_sheet>& stock)
+{
+	input_parser in(text);
+	while (in.next_line())
+	{
+		stock_sheet s;
+		s.width = in.read_int("stock width", 1, INT_MAX);
+		s.height = in.read_int("stock height", 1, INT_MAX);
+		s.count = in.read_int("stock count", -1, INT_MAX);
+		s.cost = in.read_int("stock cost", 0, INT_MAX);
+		in.end_line();
+		stock.push_back(s);
+	}
+	if (stock.empty())
+		in.fail("no stock sheets");
+}
+
+vector <stock_sheet> read_stock(const string& path)
+{
+	mapped_file file(path);
+	vector <stock_sheet> stock;
+	try
+	{
+		parse_stock(file.text(), stock);
+	}
+	catch (const runtime_error& e)
+	{
+		throw runtime_error(path + ", " + e.what());
+	}
+	return stock;
+}
+
+//Smallest (or largest) available stock sheet a rectangle fits on, in either orientation if it may turn.
+//Sheets are kept by area in a segment tree where every node has a free_staircase
+//of the sizes below it, like sheet_index. A used up sheet drops out with an empty staircase
+class stock_index
+{
+private:
+	int capacity = 0;
+	vector <free_staircase> nodes;
+	vector <int> order;
+	vector <int> position; //leaf of every stock sheet in order, -1 if it is not indexed
+	vector <pair<int, int>> points;
+
+	void pull(int node)
+	{
+		const free_staircase& l = nodes[node * 2];
+		const free_staircase& r = nodes[node * 2 + 1];
+		points.clear();
+		for (int i = 0; i < l.steps; ++i) points.push_back({ l.w[i], l.h[i] });
+		for (int i = 0; i < r.steps; ++i) points.push_back({ r.w[i], r.h[i] });
+		sort(points.begin(), points.end(), [](auto& a, auto& b) { return (a.first > b.first) || ((a.first == b.first) && (a.second > b.second)); });
+		nodes[node].build(points.data(), points.size());
+	}
+
+	int search(int node, int w, int h, bool rotatable, span<const stock_sheet> stock) const
+	{
+		if (!nodes[node].can_fit(w, h) && !(rotatable && nodes[node].can_fit(h, w)))
+			return -1;
+		if (node >= capacity)
+		{
+			const stock_sheet& s = stock[order[node - capacity]];
+			bool fits = ((w <= s.width) && (h <= s.height)) || (rotatable && (h <= s.width) && (w <= s.height));
+			return fits ? order[node - capacity] : -1;
+		}
+		int k = search(node * 2, w, h, rotatable, stock);
+		return (k != -1) ? k : search(node * 2 + 1, w, h, rotatable, stock);
+	}
+
+public:
+	//Indexes the remnants, or the boards, that are still in stock
+	void build(span<const stock_sheet> stock, bool remnants, bool largest_first = false)
+	{
+		order.clear();
+		for (int k = 0; k < stock.size(); ++k)
+		{
+			if ((stock[k].remnant == remnants) && (stock[k].count != 0))
+				order.push_back(k);
+		}
+		stable_sort(order.begin(), order.end(), [&](int a, int b)
+		{
+			long long area_a = (long long)stock[a].width * stock[a].height, area_b = (long long)stock[b].width * stock[b].height;
+			return largest_first ? area_a > area_b : area_a < area_b;
+		});
+		position.assign(stock.size(), -1);
+		for (int i = 0; i < order.size(); ++i)
+			position[order[i]] = i;
+		capacity = 1;
+		while (capacity < max<int>(order.size(), 1)) capacity *= 2;
+		nodes.assign(capacity * 2, free_staircase());
+		for (int i = 0; i < order.size(); ++i)
+		{
+			free_staircase& leaf = nodes[capacity + i];
+			leaf.steps = 1;
+			leaf.w[0] = stock[order[i]].width;
+			leaf.h[0] = stock[order[i]].height;
+		}
+		for (int node = capacity - 1; node > 0; --node)
+			pull(node);
+	}
+
+	//Stock sheet k ran out
+	void close(int k)
+	{
+		if ((k < 0) || (k >= position.size()) || (position[k] == -1))
+			return;
+		int node = capacity + position[k];
+		position[k] = -1;
+		nodes[node].steps = 0;
+		for (node /= 2; node > 0; node /= 2)
+			pull(node);
+	}
+
+	//Index of the first stock sheet in area order w x h fits on, -1 if there is none
+	int find_first(int w, int h, bool rotatable, span<const stock_sheet> stock) const
+	{
+		return order.empty() ? -1 : search(1, w, h, rotatable, stock);
+	}
+};
+
+//Tries to cut all of parts out of one empty sheet, biggest first, each into the smallest free leaf.
+//On success data gets the new turns and places
+bool fill_sheet(guillotine_sheet& sheet, span<Rectangle> data, const vector <int>& parts)
+{
+	vector <int> free_nodes = { 0 };
+	vector <Rectangle> trial;
+	for (int p : parts)
+	{
+		Rectangle r = data[p];
+		int best = -1;
+		bool rotated = false;
+		long long best_area = LLONG_MAX;
+		for (int i = 0; i < free_nodes.size(); ++i)
+		{
+			const cut_node& leaf = sheet.nodes[free_nodes[i]];
+			long long area = (long long)leaf.w * leaf.h;
+			bool fits = (r.width <= leaf.w) && (r.height <= leaf.h);
+			bool fits_rotated = r.is_rotatable() && (r.height <= leaf.w) && (r.width <= leaf.h);
+			if ((fits || fits_rotated) && (area < best_area))
+			{
+				best = i;
+				best_area = area;
+				rotated = !fits;
+			}
+		}
+		if (best == -1)
+			return false;
+		int node = free_nodes[best];
+		free_nodes.erase(free_nodes.begin() + best);
+		if (rotated) r.rotate();
+		sheet.place(node, r.width, r.height, p, free_nodes);
+		r.x = sheet.nodes[node].x;
+		r.y = sheet.nodes[node].y;
+		trial.push_back(r);
+	}
+	for (int i = 0; i < parts.size(); ++i)
+		data[parts[i]] = trial[i];
+	return true;
+}
+
+//Guillotine packing over an inventory of stock sheets, the total cost of the sheets used is kept low.
+//Parts go biggest first into the smallest free leaf of an open sheet, like guillotine_part. When none
+//fits, a sheet is opened: the smallest remnant that fits or one of the boards, whichever costs least
+//per area it will really hold (its area, or the area still to be packed if that is less).
+//Afterwards every sheet is tried on cheaper stock and moved there if its parts fit.
+//Output is in algorythm() form: saw width added to sizes, dspN is the sheet, y counted inside it,
+//sheet_stock[i] is the stock entry sheet i is cut from. Throws if a part fits no stock or stock runs out
+void stock_part(span<const Rectangle> input, span<const stock_sheet> inventory, int saw_width, double& total_cost, vector <Rectangle>& data, vector <guillotine_sheet>& sheets, vector <int>& sheet_stock, pack_scratch& scratch)
+{
+	total_cost = 0;
+	sheets.clear();
+	sheet_stock.clear();
+	data.assign(input.begin(), input.end());
+	if (data.empty()) return;
+	vector <stock_sheet> stock(inventory.begin(), inventory.end());
+	sort_by_key(data, key_area, scratch);
+	vector <int>& min_side = scratch.min_side;
+	min_side.assign(data.size() + 1, INT_MAX);
+	vector <long long> rest_area(data.size() + 1, 0);
+	for (int i = data.size() - 1; i >= 0; --i)
+	{
+		min_side[i] = min<int>(min_side[i + 1], min(data[i].width, data[i].height));
+		rest_area[i] = rest_area[i + 1] + (long long)(data[i].width + saw_width) * (data[i].height + saw_width);
+	}
+	stock_index remnants;
+	remnants.build(stock, true);
+
+	auto take = [&](int k)
+	{
+		if ((stock[k].count > 0) && (--stock[k].count == 0) && stock[k].remnant)
+			remnants.close(k);
+	};
+
+	set<tuple<long long, int, int>> free_leaves;
+	vector <int> new_free;
+	for (int i = 0; i < data.size(); ++i)
+	{
+		int sheet = -1, node = 0;
+		bool rotated = false;
+		long long area = (long long)data[i].width * data[i].height;
+		for (auto it = free_leaves.lower_bound({ area, -1, -1 }); it != free_leaves.end();)
+		{
+			const cut_node& leaf = sheets[get<1>(*it)].nodes[get<2>(*it)];
+			if ((leaf.w < min_side[i]) || (leaf.h < min_side[i]))
+			{
+				it = free_leaves.erase(it);
+				continue;
+			}
+			bool fits = (data[i].width <= leaf.w) && (data[i].height <= leaf.h);
+			bool fits_rotated = data[i].is_rotatable() && (data[i].height <= leaf.w) && (data[i].width <= leaf.h);
+			if (fits || fits_rotated)
+			{
+				sheet = get<1>(*it); node = get<2>(*it);
+				rotated = !fits;
+				free_leaves.erase(it);
+				break;
+			}
+			++it;
+		}
+		if (sheet == -1)
+		{
+			int w = data[i].width, h = data[i].height;
+			bool rotatable = data[i].is_rotatable();
+			int best = remnants.find_first(w, h, rotatable, stock);
+			auto score = [&](int k)
+			{
+				long long holds = min((long long)(stock[k].width + saw_width) * (stock[k].height + saw_width), rest_area[i]);
+				return stock[k].cost / holds;
+			};
+			for (int k = 0; k < stock.size(); ++k)
+			{
+				if (stock[k].remnant || (stock[k].count == 0))
+					continue;
+				bool fits = ((w <= stock[k].width) && (h <= stock[k].height)) || (rotatable && (h <= stock[k].width) && (w <= stock[k].height));
+				if (fits && ((best == -1) || (score(k) < score(best))))
+					best = k;
+			}
+			if (best == -1)
+			{
+				for (auto& s : inventory)
+				{
+					if (((w <= s.width) && (h <= s.height)) || (rotatable && (h <= s.width) && (w <= s.height)))
+						throw runtime_error("Not enough stock sheets");
+				}
+				throw runtime_error("One of rectangles can't fit in any stock sheet");
+			}
+			take(best);
+			sheet = sheets.size();
+			sheets.emplace_back(stock[best].width, stock[best].height, saw_width);
+			sheet_stock.push_back(best);
+			rotated = !((w <= stock[best].width) && (h <= stock[best].height));
+		}
+		if (rotated) data[i].rotate();
+		new_free.clear();
+		sheets[sheet].place(node, data[i].width, data[i].height, i, new_free);
+		data[i].x = sheets[sheet].nodes[node].x;
+		data[i].y = sheets[sheet].nodes[node].y;
+		data[i].dspN = sheet;
+		for (int f : new_free)
+		{
+			const cut_node& leaf = sheets[sheet].nodes[f];
+			free_leaves.insert({ (long long)leaf.w * leaf.h, sheet, f });
+		}
+	}
+
+	//Move sheets to cheaper stock where their parts fit, cheapest first
+	vector <vector <int>> parts(sheets.size());
+	for (int i = 0; i < data.size(); ++i)
+		parts[data[i].dspN].push_back(i);
+	vector <int> cheaper(stock.size());
+	iota(cheaper.begin(), cheaper.end(), 0);
+	stable_sort(cheaper.begin(), cheaper.end(), [&](int a, int b) { return stock[a].cost < stock[b].cost; });
+	for (int s = 0; s < sheets.size(); ++s)
+	{
+		long long used = 0;
+		for (int p : parts[s])
+			used += (long long)data[p].width * data[p].height;
+		for (int k : cheaper)
+		{
+			if (stock[k].cost >= stock[sheet_stock[s]].cost)
+				break;
+			if ((stock[k].count == 0) || ((long long)stock[k].width * stock[k].height < used))
+				continue;
+			guillotine_sheet trial(stock[k].width, stock[k].height, saw_width);
+			if (!fill_sheet(trial, data, parts[s]))
+				continue;
+			if (stock[sheet_stock[s]].count >= 0)
+				stock[sheet_stock[s]].count++;
+			take(k);
+			sheets[s] = move(trial);
+			sheet_stock[s] = k;
+			break;
+		}
+	}
+
+	for (auto& r : data)
+	{
+		r.width += saw_width;
+		r.height += saw_width;
+	}
+	for (int k : sheet_stock)
+		total_cost += stock[k].cost;
+}
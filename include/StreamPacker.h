@@ -0,0 +1,256 @@
+#pragma once
+#include "Algorythm.h"
+#include <functional>
+
+//Gets a finished list: its number and its parts in algorythm() form, saw width added to sizes,
+//dspN set and y counted inside the list. Lists can finish out of number order
+typedef function<void(int, span<const Rectangle>)> list_writer;
+
+//Shelf packing for cut lists too big to hold in memory. Parts come one at a time and go by height into
+//buckets, heights in a bucket differ by at most bucket_ratio. Every bucket has one open shelf, a full
+//shelf is closed onto the open list it fills best, and a list is written out and dropped once nothing
+//fits on it anymore or open_lists lists are open already. Memory is bounded by the open shelves and
+//lists, whatever the part count
+class stream_packer
+{
+private:
+	struct shelf
+	{
+		int width = 0;
+		int height = 0;
+		vector <Rectangle> parts;
+	};
+	//Free room on a list beside the shelves, right of the last part of a shelf at first
+	struct gap
+	{
+		int x;
+		int y;
+		int width;
+		int height;
+	};
+	//number -1 is a free slot, its buffers are kept for the next list
+	struct open_list
+	{
+		int number = -1;
+		int top = 0;
+		vector <Rectangle> parts;
+		vector <gap> gaps;
+	};
+
+	int dsp_w, dsp_h, saw_width, list_w, list_h;
+	size_t open_lists;
+	list_writer write;
+	vector <int> limits; //bucket k takes heights in (limits[k + 1], limits[k]]
+	vector <shelf> shelves;
+	vector <open_list> lists;
+	int next_list = 0;
+	int min_height = INT_MAX;
+	int min_width = INT_MAX;
+	long long area = 0;
+	size_t held = 0, peak = 0;
+
+	int bucket(int h) const
+	{
+		return upper_bound(limits.begin(), limits.end(), h, greater<int>()) - limits.begin() - 1;
+	}
+
+	void write_list(open_list& l)
+	{
+		write(l.number, l.parts);
+		held -= l.parts.size();
+		l.parts.clear();
+		l.gaps.clear();
+		l.number = -1;
+	}
+
+	void close_shelf(shelf& s)
+	{
+		if (s.parts.empty())
+			return;
+		int best = -1, free_slot = -1;
+		for (int i = 0; i < lists.size(); ++i)
+		{
+			if (lists[i].number == -1)
+			{
+				if (free_slot == -1) free_slot = i;
+				continue;
+			}
+			if ((lists[i].top + s.height <= list_h) && ((best == -1) || (lists[i].top > lists[best].top)))
+				best = i;
+		}
+		if (best == -1)
+		{
+			if ((free_slot == -1) && (lists.size() < open_lists))
+			{
+				free_slot = lists.size();
+				lists.emplace_back();
+			}
+			if (free_slot == -1)
+			{
+				//the shelf fits on no open list, the fullest one makes room
+				free_slot = max_element(lists.begin(), lists.end(), [](auto& a, auto& b) { return a.top < b.top; }) - lists.begin();
+				write_list(lists[free_slot]);
+			}
+			best = free_slot;
+			lists[best].number = next_list++;
+			lists[best].top = 0;
+		}
+		open_list& l = lists[best];
+		for (auto& r : s.parts)
+		{
+			r.y = l.top;
+			r.dspN = l.number;
+			l.parts.push_back(r);
+		}
+		add_gap(l, s.width, l.top, list_w - s.width, s.height);
+		l.top += s.height;
+		s.parts.clear();
+		s.width = 0; s.height = 0;
+		if (list_h - l.top < min_height)
+			write_list(l);
+	}
+
+	void add_gap(open_list& l, int x, int y, int w, int h)
+	{
+		if ((w >= min_width) && (h >= min_height))
+			l.gaps.push_back({ x, y, w, h });
+	}
+
+	//Puts r into the smallest gap on an open list it fits. The gap is cut like a guillotine leaf:
+	//the room right of r keeps the full height of the gap, the room above r gets its width
+	bool place_in_gap(Rectangle& r)
+	{
+		open_list* best_list = nullptr;
+		int best = -1;
+		long long best_area = LLONG_MAX;
+		for (auto& l : lists)
+		{
+			if (l.number == -1) continue;
+			for (int i = 0; i < l.gaps.size(); ++i)
+			{
+				const gap& g = l.gaps[i];
+				long long area = (long long)g.width * g.height;
+				if ((r.width <= g.width) && (r.height <= g.height) && (area < best_area))
+				{
+					best_list = &l;
+					best = i;
+					best_area = area;
+				}
+			}
+		}
+		if (best == -1)
+			return false;
+		gap g = best_list->gaps[best];
+		best_list->gaps[best] = best_list->gaps.back();
+		best_list->gaps.pop_back();
+		r.x = g.x;
+		r.y = g.y;
+		r.dspN = best_list->number;
+		best_list->parts.push_back(r);
+		add_gap(*best_list, g.x + r.width, g.y, g.width - r.width, g.height);
+		add_gap(*best_list, g.x, g.y + r.height, r.width, g.height - r.height);
+		peak = max(peak, ++held);
+		return true;
+	}
+
+public:
+	stream_packer(int dsp_w, int dsp_h, int saw_width, list_writer write, size_t open_lists = 8, double bucket_ratio = 0.9) :
+		dsp_w(dsp_w), dsp_h(dsp_h), saw_width(saw_width), list_w(dsp_w + saw_width), list_h(dsp_h + saw_width),
+		open_lists(max<size_t>(open_lists, 1)), write(move(write))
+	{
+		if ((bucket_ratio <= 0) || (bucket_ratio >= 1))
+			throw "Bucket ratio must be between 0 and 1";
+		limits.push_back(list_h);
+		while (limits.back() > 1)
+			limits.push_back(min<int>(limits.back() - 1, max<int>(1, limits.back() * bucket_ratio)));
+		limits.push_back(0);
+		shelves.resize(limits.size() - 1);
+	}
+
+	//Part in real sizes, turned and locked like fit_to_dsp does. Throws if it fits no way
+	void add(Rectangle r)
+	{
+		fit_part_to_dsp(r, dsp_w, dsp_h);
+		//lying flat keeps shelves low
+		if (r.is_rotatable() && (r.height > r.width) && (r.height <= dsp_w) && (r.width <= dsp_h))
+			r.rotate();
+		r.width += saw_width;
+		r.height += saw_width;
+		min_height = min<int>(min_height, r.height);
+		min_width = min<int>(min_width, r.width);
+		area += (long long)r.width * r.height;
+		if (place_in_gap(r))
+			return;
+		shelf& s = shelves[bucket(r.height)];
+		if (s.width + r.width > list_w)
+			close_shelf(s);
+		r.x = s.width;
+		s.width += r.width;
+		s.height = max<int>(s.height, r.height);
+		s.parts.push_back(r);
+		peak = max(peak, ++held);
+	}
+
+	//Closes the open shelves, tallest first, and writes out every list that is left in number order.
+	//The packer is empty afterwards and can take the next cut list
+	void finish(int& total_count, double& percentage)
+	{
+		for (auto& s : shelves)
+			close_shelf(s);
+		while (true)
+		{
+			open_list* first = nullptr;
+			for (auto& l : lists)
+			{
+				if ((l.number != -1) && (!first || (l.number < first->number)))
+					first = &l;
+			}
+			if (!first) break;
+			write_list(*first);
+		}
+		total_count = next_list;
+		percentage = total_count ? ((double)area / list_w) / ((long long)list_h * total_count) : 0;
+		next_list = 0;
+		min_height = INT_MAX;
+		min_width = INT_MAX;
+		area = 0;
+	}
+
+	//Most parts held at once so far
+	size_t peak_parts() const
+	{
+		return peak;
+	}
+};
+
+//Packs the cut-list file at in_path with a stream_packer, reading it a part at a time, and writes
+//every list to out in write_output lines as soon as it is done
+void stream_pack_file(const string& in_path, ostream& out, int& total_count, double& percentage, size_t open_lists = 8, double bucket_ratio = 0.9)
+{
+	mapped_file file(in_path);
+	try
+	{
+		input_parser in(file.text());
+		int dsp_w = 0, dsp_h = 0, saw_width = 0;
+		int n = read_header(in, dsp_w, dsp_h, saw_width);
+		stream_packer packer(dsp_w, dsp_h, saw_width, [&](int, span<const Rectangle> parts)
+		{
+			for (auto& r : parts)
+				write_part(out, r);
+		}, open_lists, bucket_ratio);
+		for (int i = 0; i < n; ++i)
+		{
+			if (!in.next_line())
+				in.fail("expected " + to_string(n) + " parts, got " + to_string(i));
+			packer.add(read_part(in, i));
+		}
+		if (in.next_line())
+			in.fail("more parts than the count of " + to_string(n));
+		packer.finish(total_count, percentage);
+	}
+	catch (const runtime_error& e)
+	{
+		throw runtime_error(in_path + ", " + e.what());
+	}
+	out << flush;
+}
@@ -0,0 +1,120 @@
+#pragma once
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <type_traits>
+#include <exception>
+#include <utility>
+
+//Threads that live as long as the pool, so running a batch of tasks neither starts threads nor allocates.
+//run() hands task numbers 0..count-1 to the workers and to the calling thread, and returns when all
+//of them are done. One batch runs at a time, a task must not call run() on the same pool.
+//A task that throws stops the batch: tasks not started yet are skipped, and once every thread is out
+//of it run() rethrows the first exception.
+class worker_pool
+{
+private:
+	std::vector<std::thread> threads;
+	std::mutex batch_mutex;
+	std::mutex m;
+	std::condition_variable wake;
+	std::condition_variable done;
+	size_t generation = 0;
+	size_t running = 0;
+	bool stopping = false;
+
+	std::atomic<size_t> next{ 0 };
+	size_t count = 0;
+	void (*call)(void*, size_t) = nullptr;
+	void* task = nullptr;
+	std::exception_ptr failure;
+
+	void work()
+	{
+		try
+		{
+			for (size_t i = next++; i < count; i = next++)
+				call(task, i);
+		}
+		catch (...)
+		{
+			next = count;
+			std::lock_guard<std::mutex> lock(m);
+			if (!failure)
+				failure = std::current_exception();
+		}
+	}
+
+	void loop()
+	{
+		size_t seen = 0;
+		while (true)
+		{
+			{
+				std::unique_lock<std::mutex> lock(m);
+				wake.wait(lock, [&] { return stopping || (generation != seen); });
+				if (stopping) return;
+				seen = generation;
+			}
+			work();
+			std::lock_guard<std::mutex> lock(m);
+			if (--running == 0)
+				done.notify_one();
+		}
+	}
+
+public:
+	//The thread calling run() works too, so workers - 1 threads are started
+	explicit worker_pool(unsigned int workers = std::thread::hardware_concurrency())
+	{
+		for (unsigned int i = 1; i < workers; ++i)
+			threads.emplace_back(&worker_pool::loop, this);
+	}
+
+	~worker_pool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m);
+			stopping = true;
+		}
+		wake.notify_all();
+		for (auto& t : threads)
+			t.join();
+	}
+
+	size_t size() const
+	{
+		return threads.size() + 1;
+	}
+
+	template <class F>
+	void run(size_t tasks, F&& f)
+	{
+		std::lock_guard<std::mutex> batch(batch_mutex);
+		{
+			std::lock_guard<std::mutex> lock(m);
+			call = [](void* t, size_t i) { (*static_cast<std::remove_reference_t<F>*>(t))(i); };
+			task = (void*)&f;
+			count = tasks;
+			next = 0;
+			running = threads.size();
+			failure = nullptr;
+			generation++;
+		}
+		wake.notify_all();
+		work();
+		std::unique_lock<std::mutex> lock(m);
+		done.wait(lock, [&] { return running == 0; });
+		task = nullptr;
+		if (failure)
+			std::rethrow_exception(std::exchange(failure, nullptr));
+	}
+
+	static worker_pool& shared()
+	{
+		static worker_pool pool;
+		return pool;
+	}
+};
@@ -0,0 +1,450 @@
+//
+// Cluster tests: the edge index against the clusters under random splits, separator moves and deletes,
+// undo and redo, point location, scene links, saving designs as JSON and binary catalogs and the cut list
+// of a design. Builds against the glm and Tools.hpp stand-ins in shim/. Prints the checks that fail and
+// exits with 1 if there are any.
+//
+
+#include "ClusterFile.h"
+#include "CutList.h"
+#include <array>
+#include <set>
+#include <filesystem>
+
+int failures = 0;
+
+#define CHECK(cond) \
+	do { if (!(cond)) { cerr << __FILE__ << ":" << __LINE__ << ": " << #cond << endl; failures++; } } while (0)
+
+//Scene object the tests link to clusters, tag tells them apart after a load
+struct tagged : IObject
+{
+	int tag;
+	explicit tagged(int tag) : tag(tag) {}
+};
+
+int tag_of(const IObject* o)
+{
+	return o ? static_cast<const tagged*>(o)->tag : -1;
+}
+
+//Splits the leaf at (x, y) mm, returns the split cluster or NO_CLUSTER
+ClusterId split_at(ClusterManager& design, int x, int y, int width, bool vertical)
+{
+	return design.trySplit(glm::vec3(to_mm(x), to_mm(y), 0), width, vertical);
+}
+
+//Live clusters by their bounds, leaf flag and tag of the linked object, in a stable order
+typedef vector<array<int, 6>> snapshot;
+snapshot snap(const ClusterManager& design)
+{
+	snapshot s;
+	for (ClusterId id : design.getClusters())
+	{
+		const Cluster& c = design.get(id);
+		s.push_back({ c.getLower().x, c.getLower().y, c.getUpper().x, c.getUpper().y, (int)c.isLeaf(), tag_of(design.getLinkedObject(id)) });
+	}
+	sort(s.begin(), s.end());
+	return s;
+}
+
+vector<ClusterId> inner_clusters(const ClusterManager& design)
+{
+	vector<ClusterId> inner;
+	for (ClusterId id : design.getClusters())
+		if (!design.get(id).isLeaf())
+			inner.push_back(id);
+	return inner;
+}
+
+//Every edge of every coordinate seen so far lists exactly the live clusters lying on it
+struct edge_check
+{
+	set<pair<int, int>> lower, upper;
+
+	void see(const ClusterManager& design)
+	{
+		for (ClusterId id : design.getClusters())
+		{
+			const Cluster& c = design.get(id);
+			for (int axis = 0; axis < 2; ++axis)
+			{
+				lower.insert({ axis, c.getLower()[axis] });
+				upper.insert({ axis, c.getUpper()[axis] });
+			}
+		}
+	}
+
+	bool same(const ClusterManager& design, const EdgeIndex& index, const set<pair<int, int>>& edges, bool is_upper) const
+	{
+		for (auto [axis, coordinate] : edges)
+		{
+			vector<ClusterId> expected;
+			for (ClusterId id : design.getClusters())
+			{
+				const Cluster& c = design.get(id);
+				if ((is_upper ? c.getUpper() : c.getLower())[axis] == coordinate)
+					expected.push_back(id);
+			}
+			const vector<ClusterId>* found = index.find(axis, coordinate);
+			vector<ClusterId> listed = found ? *found : vector<ClusterId>();
+			sort(expected.begin(), expected.end());
+			sort(listed.begin(), listed.end());
+			if ((listed != expected) || (found && found->empty()))
+				return false;
+		}
+		return true;
+	}
+
+	bool operator()(const ClusterManager& design)
+	{
+		see(design);
+		const ClusterState& state = design.getState();
+		return same(design, state.lowerEdges, lower, false) && same(design, state.upperEdges, upper, true);
+	}
+};
+
+void test_edges()
+{
+	for (unsigned int seed = 1; seed <= 20; ++seed)
+	{
+		mt19937 gen(seed);
+		ClusterManager design(glm::ivec3(20000, 20000, 500), glm::vec3(0, 0, 0));
+		edge_check edges;
+		bool consistent = true;
+		for (int step = 0; step < 300; ++step)
+		{
+			int op = gen() % 10;
+			vector<ClusterId> inner = inner_clusters(design);
+			if ((op < 4) || inner.empty())
+				split_at(design, gen() % 20000, gen() % 20000, (gen() % 3) * 18, gen() % 2);
+			else if (op < 7)
+				design.tryMoveSeparator(inner[gen() % inner.size()], (int)(gen() % 2001) - 1000);
+			else if (op < 8)
+				design.getClustersToDelete(inner[gen() % inner.size()]);
+			else if (op < 9)
+				design.undo();
+			else
+				design.redo();
+			consistent = consistent && edges(design);
+		}
+		CHECK(consistent);
+
+		//batch moves and a resize keep the index too
+		vector<SeparatorTarget> targets;
+		for (ClusterId id : inner_clusters(design))
+		{
+			const Cluster& c = design.get(id);
+			int axis = !design.isVertical(id);
+			targets.push_back({ id, (c.getLower()[axis] + c.getUpper()[axis]) / 2 });
+			if (targets.size() == 3) break;
+		}
+		design.trySetSeparators(targets);
+		CHECK(edges(design));
+		design.tryResize(glm::ivec2(25000, 22000));
+		CHECK(edges(design));
+		design.compact();
+		CHECK(edges(design));
+	}
+}
+
+//Every edit is one step back and one step forward, the design comes back exactly as it was
+void test_undo_redo()
+{
+	mt19937 gen(3);
+	ClusterManager design(glm::ivec3(20000, 20000, 500), glm::vec3(0, 0, 0));
+	CHECK(!design.canUndo() && !design.undo());
+	vector<snapshot> versions = { snap(design) };
+	for (int step = 0; step < 200; ++step)
+	{
+		vector<ClusterId> inner = inner_clusters(design);
+		int op = gen() % 4;
+		if ((op < 2) || inner.empty())
+			split_at(design, gen() % 20000, gen() % 20000, 18, gen() % 2);
+		else if (op < 3)
+			design.tryMoveSeparator(inner[gen() % inner.size()], (int)(gen() % 201) - 100);
+		else
+			design.getClustersToDelete(inner[gen() % inner.size()]);
+		snapshot now = snap(design);
+		//a rejected edit leaves no step behind
+		if (now == versions.back())
+			continue;
+		versions.push_back(now);
+	}
+	bool same = true;
+	for (size_t v = versions.size() - 1; v > 0; --v)
+		same = same && design.undo() && (snap(design) == versions[v - 1]);
+	CHECK(same && !design.canUndo());
+	for (size_t v = 1; v < versions.size(); ++v)
+		same = same && design.redo() && (snap(design) == versions[v]);
+	CHECK(same && !design.canRedo());
+
+	//an edit after undo drops the steps undone
+	design.undo();
+	split_at(design, 1, 1, 0, true);
+	CHECK(!design.canRedo());
+}
+
+//Links stay with the cluster they were set on through edits, undo and redo
+void test_links()
+{
+	tagged left(1), right(2);
+	ClusterManager design(glm::ivec3(2000, 1000, 500), glm::vec3(0, 0, 0));
+	ClusterId root = split_at(design, 1000, 500, 18, true);
+	ClusterId a = design.toLocalCluster(glm::ivec2(10, 10));
+	ClusterId b = design.toLocalCluster(glm::ivec2(1990, 10));
+	design.setLinkedObject(a, &left);
+	design.setLinkedObject(b, &right);
+	design.tryMoveSeparator(root, 100);
+	CHECK((tag_of(design.getLinkedObject(a)) == 1) && (tag_of(design.getLinkedObject(b)) == 2));
+	design.undo();
+	design.undo();
+	CHECK(design.getLinkedObject(a) == nullptr);
+	design.redo();
+	CHECK((tag_of(design.getLinkedObject(a)) == 1) && (tag_of(design.getLinkedObject(b)) == 2));
+
+	//the ids of a deleted pair go to the next split, which starts unlinked. Undoing back to the first
+	//pair brings its objects back with it
+	design.redo();
+	design.getClustersToDelete(root);
+	ClusterId again = split_at(design, 500, 500, 18, false);
+	CHECK(again == root);
+	CHECK((design.toLocalCluster(glm::ivec2(10, 10)) == a) && (design.getLinkedObject(a) == nullptr));
+	tagged top(3);
+	design.setLinkedObject(design.toLocalCluster(glm::ivec2(10, 990)), &top);
+	design.undo();
+	design.undo();
+	CHECK((tag_of(design.getLinkedObject(a)) == 1) && (tag_of(design.getLinkedObject(b)) == 2));
+	design.redo();
+	design.redo();
+	CHECK(tag_of(design.getLinkedObject(design.toLocalCluster(glm::ivec2(10, 990)))) == 3);
+	CHECK(design.getLinkedObject(design.toLocalCluster(glm::ivec2(10, 10))) == nullptr);
+
+	//compact() moves ids around in the current version only, undo goes back to the old ones and
+	//both keep their links
+	mt19937 gen(11);
+	ClusterManager big(glm::ivec3(20000, 20000, 500), glm::vec3(0, 0, 0));
+	vector<unique_ptr<tagged>> objects;
+	for (int i = 0; i < 40; ++i)
+	{
+		split_at(big, gen() % 20000, gen() % 20000, 18, gen() % 2);
+		if (i % 10 == 9)
+			big.getClustersToDelete(inner_clusters(big)[gen() % inner_clusters(big).size()]);
+	}
+	for (ClusterId id : big.getClusters())
+	{
+		objects.push_back(make_unique<tagged>(objects.size()));
+		big.setLinkedObject(id, objects.back().get());
+	}
+	big.tryMoveSeparator(inner_clusters(big)[0], 5);
+	snapshot moved = snap(big);
+	big.undo();
+	snapshot before = snap(big);
+	big.redo();
+	big.compact();
+	CHECK(snap(big) == moved);
+	big.undo();
+	CHECK(snap(big) == before);
+	big.redo();
+	CHECK(snap(big) == moved);
+}
+
+//A design with links saved and loaded in both forms comes back the same
+void test_io()
+{
+	vector<unique_ptr<tagged>> objects;
+	ObjectCodec codec;
+	codec.save = [](const IObject* o) { return nlohmann::json{ { "tag", tag_of(o) } }; };
+	codec.load = [&](const nlohmann::json& j) -> IObject*
+	{
+		objects.push_back(make_unique<tagged>(j.at("tag").get<int>()));
+		return objects.back().get();
+	};
+
+	mt19937 gen(5);
+	ClusterManager design(glm::ivec3(20000, 20000, 500), glm::vec3(1, 2, 3));
+	for (int i = 0; i < 60; ++i)
+		split_at(design, gen() % 20000, gen() % 20000, 18, gen() % 2);
+	vector<unique_ptr<tagged>> linked;
+	for (ClusterId id : design.getClusters())
+	{
+		if (!design.get(id).isLeaf() || (gen() % 2))
+			continue;
+		linked.push_back(make_unique<tagged>(id));
+		design.setLinkedObject(id, linked.back().get());
+	}
+	//one object on two clusters is written once
+	vector<ClusterId> leaves;
+	for (ClusterId id : design.getClusters())
+		if (design.get(id).isLeaf()) leaves.push_back(id);
+	design.setLinkedObject(leaves[0], linked[0].get());
+	design.setLinkedObject(leaves[1], linked[0].get());
+
+	set<const IObject*> distinct;
+	for (ClusterId id : design.getClusters())
+		if (design.getLinkedObject(id)) distinct.insert(design.getLinkedObject(id));
+
+	snapshot expected = snap(design);
+	nlohmann::json j = ClusterIO::toJson(design, codec);
+	ClusterManager back = ClusterIO::fromJson(nlohmann::json::parse(j.dump()), codec);
+	CHECK(snap(back) == expected);
+	CHECK((j["objects"].size() == distinct.size()) && (objects.size() == distinct.size()));
+	CHECK(edge_check()(back));
+
+	string path = (filesystem::temp_directory_path() / "cluster_tests.wdsg").string();
+	ClusterIO::save(path, { { "first", &design }, { "second", &back } }, codec);
+	{
+		DesignCatalog catalog(path);
+		CHECK((catalog.size() == 2) && (catalog.name(1) == "second"));
+		CHECK(catalog.clusterCount(0) == design.getClusters().size());
+		CHECK(snap(catalog.load(0, codec)) == expected);
+		CHECK(snap(catalog.load(1, codec)) == expected);
+		//a subtree comes back as a design of its own, record 1 is the first child of the root
+		ClusterId top = design.getClusters()[1];
+		snapshot under;
+		for (ClusterId id : design.getClusters())
+		{
+			ClusterId up = id;
+			while ((up != top) && (up != NO_CLUSTER))
+				up = design.get(up).getParent();
+			const Cluster& c = design.get(id);
+			if (up == top)
+				under.push_back({ c.getLower().x, c.getLower().y, c.getUpper().x, c.getUpper().y, (int)c.isLeaf(), tag_of(design.getLinkedObject(id)) });
+		}
+		sort(under.begin(), under.end());
+		CHECK(snap(catalog.load(0, codec, 1)) == under);
+	}
+	filesystem::remove(path);
+
+	//broken files are refused
+	nlohmann::json bad = j;
+	bad["root"]["children"] = nlohmann::json::array({ bad["root"]["children"][0] });
+	bool threw = false;
+	try
+	{
+		ClusterIO::fromJson(bad);
+	}
+	catch (const runtime_error&)
+	{
+		threw = true;
+	}
+	CHECK(threw);
+}
+
+//Point location finds the leaf a point lies inside of through edits, undo, redo and compact()
+void test_locate()
+{
+	mt19937 gen(5);
+	ClusterManager design(glm::ivec3(20000, 20000, 500), glm::vec3(0, 0, 0));
+	auto located = [&]()
+	{
+		bool right = true;
+		vector<ClusterId> leaves;
+		for (ClusterId id : design.getClusters())
+			if (design.get(id).isLeaf())
+				leaves.push_back(id);
+		for (int i = 0; i < 200; ++i)
+		{
+			glm::ivec2 pos(gen() % 20000, gen() % 20000);
+			for (ClusterId id : leaves)
+			{
+				const Cluster& c = design.get(id);
+				if ((c.getLower().x < pos.x) && (pos.x < c.getUpper().x) && (c.getLower().y < pos.y) && (pos.y < c.getUpper().y))
+					right = right && (design.toLocalCluster(pos) == id);
+			}
+		}
+		return right;
+	};
+	bool right = located();
+	for (int step = 0; step < 300; ++step)
+	{
+		vector<ClusterId> inner = inner_clusters(design);
+		int op = gen() % 8;
+		if ((op < 4) || inner.empty())
+			split_at(design, gen() % 20000, gen() % 20000, 18, gen() % 2);
+		else if (op < 5)
+			design.tryMoveSeparator(inner[gen() % inner.size()], (int)(gen() % 201) - 100);
+		else if (op < 6)
+			design.getClustersToDelete(inner[gen() % inner.size()]);
+		else if (op < 7)
+			design.undo();
+		else
+			design.compact();
+		right = right && located();
+	}
+	CHECK(right);
+	//a point on a separator is in no leaf
+	ClusterManager two(glm::ivec3(2000, 1000, 500), glm::vec3(0, 0, 0));
+	split_at(two, 1000, 500, 18, true);
+	CHECK((two.toLocalCluster(glm::ivec2(1010, 500)) == NO_CLUSTER) && (two.toLocalCluster(glm::ivec2(1020, 500)) != NO_CLUSTER));
+}
+
+//Panels are sized from the integer bounds, an edit repacks the panels it changed and no others, and a
+//panel that fits no sheet is refused without touching the plan
+void test_cut_list()
+{
+	ClusterManager design(glm::ivec3(2000, 1000, 1200), glm::vec3(0, 0, 0));
+	ClusterId root = split_at(design, 1000, 500, 18, true);
+	CHECK((panel_part(design, root) == vector<int>{ 0, 0, 1, 0, 1000, 1200 }));
+	CHECK(panel_part(design, design.toLocalCluster(glm::ivec2(10, 10))).empty());
+	for (int x : { 500, 1500, 250, 750, 1250, 1750, 375, 625, 875, 1125 })
+		split_at(design, x, 500, 18, true);
+	ClusterId column = split_at(design, 125, 500, 18, true);
+	//a split without thickness only divides a compartment
+	ClusterId mark = split_at(design, 300, 500, 0, false);
+	CHECK(panel_part(design, mark).empty());
+
+	cut_list_session cuts(1100, 2800);
+	cuts.update(design);
+	CHECK(cuts.changed_count() == 12);
+	vector<Rectangle> plan = cuts.plan();
+	CHECK(plan.size() == 12);
+
+	//moving a column changes no panel, all of them are as long as the wardrobe is high
+	design.tryMoveSeparator(column, 20);
+	cuts.update(design);
+	CHECK((cuts.changed_count() == 0) && (cuts.plan().size() == 12));
+	ClusterId shelf = split_at(design, 60, 500, 18, false);
+	cuts.update(design);
+	CHECK((cuts.changed_count() == 1) && (cuts.part_id(shelf) >= 0));
+	CHECK((panel_part(design, shelf) == vector<int>{ 0, 0, 1, 0, 145, 1200 }));
+	design.tryMoveSeparator(column, -20);
+	cuts.update(design);
+	CHECK((cuts.changed_count() == 1) && (cuts.plan().size() == 13));
+	design.undo();
+	cuts.update(design);
+	CHECK(cuts.changed_count() == 1);
+
+	//1500 x 1200 panels fit no 1100 x 2800 sheet, the session stays on the version before
+	plan = cuts.plan();
+	design.tryResize(glm::ivec2(2000, 1500));
+	bool threw = false;
+	try
+	{
+		cuts.update(design);
+	}
+	catch (const char*)
+	{
+		threw = true;
+	}
+	CHECK(threw && (cuts.changed_count() == 1) && (plan_hash(cuts.plan()) == plan_hash(plan)));
+	design.undo();
+	cuts.update(design);
+	CHECK((cuts.changed_count() == 0) && (plan_hash(cuts.plan()) == plan_hash(plan)));
+	design.getClustersToDelete(shelf);
+	cuts.update(design);
+	CHECK((cuts.changed_count() == 1) && (cuts.part_id(shelf) == -1) && (cuts.plan().size() == 12));
+}
+
+int main()
+{
+	test_edges();
+	test_undo_redo();
+	test_links();
+	test_locate();
+	test_io();
+	test_cut_list();
+	if (failures)
+		cerr << failures << " checks failed" << endl;
+	return failures ? 1 : 0;
+}
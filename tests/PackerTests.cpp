@@ -0,0 +1,371 @@
+//
+// Packer tests: grain and edge banding through fit_part_to_dsp, the cut-list parser, every engine,
+// pack_session add and resize, stock_part, the remnant store and stream_packer. Prints the checks that fail and exits with 1 if there are any.
+//
+
+#include "PackSession.h"
+#include "RemnantStore.h"
+#include "StreamPacker.h"
+#include <filesystem>
+
+int failures = 0;
+
+#define CHECK(cond) \
+	do { if (!(cond)) { cerr << __FILE__ << ":" << __LINE__ << ": " << #cond << endl; failures++; } } while (0)
+
+struct edges
+{
+	bool n, e, s, w;
+};
+
+edges edges_of(const Rectangle& r)
+{
+	return { r.north_canted, r.east_canted, r.south_canted, r.west_canted };
+}
+
+//Canted flags of a part given with e, after it was turned by +90 degrees
+edges turned(edges e)
+{
+	return { e.w, e.n, e.e, e.s };
+}
+
+bool operator==(edges a, edges b)
+{
+	return (a.n == b.n) && (a.e == b.e) && (a.s == b.s) && (a.w == b.w);
+}
+
+Rectangle part(edges e, unsigned int w, unsigned int h, Grain grain = GRAIN_NONE)
+{
+	Rectangle r(e.n, e.e, e.s, e.w, w, h);
+	r.grain = grain;
+	return r;
+}
+
+void test_fit_grain()
+{
+	//grain along the height is turned to run along the list, the bands turn with it
+	Rectangle r = part({ 1, 0, 0, 0 }, 400, 900, GRAIN_ALONG_HEIGHT);
+	fit_part_to_dsp(r, 2800, 2070);
+	CHECK((r.width == 900) && (r.height == 400));
+	CHECK(r.grain == GRAIN_ALONG_WIDTH);
+	CHECK(r.is_rotated() && !r.is_rotatable());
+	CHECK(edges_of(r) == turned({ 1, 0, 0, 0 }));
+
+	Rectangle l = part({ 0, 0, 0, 0 }, 300, 1200, GRAIN_ALONG_LENGTH);
+	fit_part_to_dsp(l, 2800, 2070);
+	CHECK((l.width == 1200) && (l.height == 300) && !l.is_rotatable());
+
+	//a part that only fits across the grain can't be cut
+	Rectangle too_long = part({ 0, 0, 0, 0 }, 400, 2500, GRAIN_ALONG_HEIGHT);
+	bool threw = false;
+	try
+	{
+		fit_part_to_dsp(too_long, 2070, 2800);
+	}
+	catch (const char*)
+	{
+		threw = true;
+	}
+	CHECK(threw);
+}
+
+void test_parse()
+{
+	int dsp_w = 0, dsp_h = 0, saw_width = 0;
+	vector <Rectangle> data;
+	parse_input("2800 2070 4\n2\n500 300 1 0 1 0\n600 400 0 1 0 0 2\n", dsp_w, dsp_h, saw_width, data);
+	CHECK((dsp_w == 2800) && (dsp_h == 2070) && (saw_width == 4));
+	CHECK(data.size() == 2);
+	CHECK((data[0].grain == GRAIN_NONE) && (data[1].grain == GRAIN_ALONG_HEIGHT));
+	CHECK(edges_of(data[0]) == edges({ 1, 0, 1, 0 }));
+
+	//a part count the text can't hold fails on the line, it doesn't try to reserve it
+	data.clear();
+	bool threw = false;
+	try
+	{
+		parse_input("2800 2070 4\n2000000000\n500 300 1 0 1 0\n", dsp_w, dsp_h, saw_width, data);
+	}
+	catch (const runtime_error&)
+	{
+		threw = true;
+	}
+	CHECK(threw);
+}
+
+void test_band_allowance()
+{
+	vector <Rectangle> data = { part({ 1, 1, 0, 0 }, 500, 300), part({ 0, 0, 0, 0 }, 200, 100) };
+	add_band_allowance(data, 2);
+	CHECK((data[0].width == 502) && (data[0].height == 302));
+	CHECK((data[1].width == 200) && (data[1].height == 100));
+}
+
+//Orders with every kind of grain and banding: whatever engine packs them, grain runs along the list
+//and every part keeps its bands, turned with it if it was turned
+void test_engines()
+{
+	mt19937 gen(7);
+	vector <Rectangle> order;
+	for (int i = 0; i < 300; ++i)
+	{
+		edges e = { (bool)(gen() % 2), (bool)(gen() % 2), (bool)(gen() % 2), (bool)(gen() % 2) };
+		Rectangle r = part(e, 100 + gen() % 1500, 100 + gen() % 900, (Grain)(gen() % 4));
+		r.id = i;
+		order.push_back(r);
+	}
+	for (PackEngine engine : { SHELF, MAXRECTS, GUILLOTINE })
+	{
+		vector <Rectangle> data = order;
+		fit_to_dsp(data, 2800, 2070);
+		pack_context ctx;
+		int total = 0;
+		double percentage = 0;
+		vector <Rectangle> plan;
+		pack(data, 2800, 2070, 4, engine, total, percentage, plan, ctx);
+		CHECK(plan.size() == order.size());
+		CHECK(total >= ctx.sheet_bound);
+		for (auto& r : plan)
+		{
+			const Rectangle& given = order[r.id];
+			edges e = edges_of(given);
+			bool turned_part = (r.width - 4 != given.width) || (r.height - 4 != given.height);
+			CHECK(turned_part == r.is_rotated());
+			CHECK(edges_of(r) == (r.is_rotated() ? turned(e) : e));
+			if (given.grain != GRAIN_NONE)
+				CHECK(r.grain == GRAIN_ALONG_WIDTH);
+		}
+	}
+}
+
+//Two levels with the same space left, in the order BF_in_order gets them. Rotating BF puts a standing
+//part on the last of them even if it is locked, a lying one and BF without rotation on the first
+void test_bf_ties()
+{
+	auto y_of = [](Rectangle r, bool locked, bool rotate)
+	{
+		if (locked) r.lock_rotation();
+		vector <Rectangle> data = { part({ 0, 0, 0, 0 }, 600, 300), part({ 0, 0, 0, 0 }, 600, 300), r };
+		pack_scratch scratch;
+		int total = 0;
+		double percentage = 0;
+		BF_in_order(data, 1000, 10000, total, percentage, rotate, scratch);
+		CHECK((data[0].y == 0) && (data[1].y == 300));
+		return data[2].y;
+	};
+	Rectangle standing = part({ 0, 0, 0, 0 }, 100, 200), lying = part({ 0, 0, 0, 0 }, 200, 100);
+	CHECK(y_of(standing, true, true) == 300);
+	CHECK(y_of(standing, true, false) == 0);
+	CHECK(y_of(lying, true, true) == 0);
+	CHECK(y_of(standing, false, true) == 0);
+	CHECK(y_of(lying, false, true) == 300);
+}
+
+void test_session_resize()
+{
+	//a panel longer than the list width has to turn, its band goes with it to the long west edge.
+	//Resizing it turns the size as given again, not the part as it lies
+	pack_session session(2070, 2800, 4);
+	int id = session.add(part({ 0, 0, 1, 0 }, 2100, 560));
+	session.resize(id, 2080, 560);
+	vector <Rectangle> plan = session.plan();
+	CHECK(plan.size() == 1);
+	CHECK((plan[0].width == 564) && (plan[0].height == 2084));
+	CHECK(plan[0].is_rotated());
+	CHECK(edges_of(plan[0]) == turned({ 0, 0, 1, 0 }));
+
+	//resizing keeps the grain, the new size is turned to it like an added part
+	int grained = session.add(part({ 1, 0, 0, 0 }, 500, 300, GRAIN_ALONG_HEIGHT));
+	session.resize(grained, 600, 300);
+	session.resize(grained, 700, 350);
+	for (auto& r : session.plan())
+	{
+		if (r.id != grained)
+			continue;
+		CHECK((r.width == 354) && (r.height == 704));
+		CHECK((r.grain == GRAIN_ALONG_WIDTH) && !r.is_rotatable());
+		CHECK(edges_of(r) == turned({ 1, 0, 0, 0 }));
+	}
+	CHECK(session.sheet_count() == 1);
+}
+
+//Runs stock_part on n square parts of size side, true if it threw
+bool stock_plan(const vector <stock_sheet>& stock, int n, int side, double& cost, vector <Rectangle>& plan, vector <int>& sheet_stock)
+{
+	vector <Rectangle> order(n, part({ 0, 0, 0, 0 }, side, side));
+	vector <guillotine_sheet> sheets;
+	pack_scratch scratch;
+	try
+	{
+		stock_part(order, stock, 4, cost, plan, sheets, sheet_stock, scratch);
+	}
+	catch (const runtime_error&)
+	{
+		return true;
+	}
+	for (auto& r : plan)
+	{
+		const stock_sheet& s = stock[sheet_stock[r.dspN]];
+		CHECK((r.x + r.width <= s.width + 4) && (r.y + r.height <= s.height + 4));
+	}
+	return false;
+}
+
+void test_stock()
+{
+	int big = 0, small = 1;
+	vector <stock_sheet> stock = { { 2800, 2070, -1, 30 }, { 1000, 1000, -1, 20 } };
+	double cost = 0;
+	vector <Rectangle> plan;
+	vector <int> sheet_stock;
+
+	//four small parts fit on the cheap board, thirty big ones go six to a big board, which is cheaper per part
+	CHECK(!stock_plan(stock, 4, 400, cost, plan, sheet_stock));
+	CHECK((sheet_stock == vector <int>{ small }) && (cost == 20));
+	CHECK(!stock_plan(stock, 30, 900, cost, plan, sheet_stock));
+	CHECK((sheet_stock.size() == 5) && (cost == 150));
+	CHECK(count(sheet_stock.begin(), sheet_stock.end(), big) == 5);
+
+	//one big board left, the rest goes one part to a small board
+	stock[big].count = 1;
+	CHECK(!stock_plan(stock, 12, 900, cost, plan, sheet_stock));
+	CHECK((sheet_stock.size() == 7) && (cost == 150));
+	CHECK(count(sheet_stock.begin(), sheet_stock.end(), big) == 1);
+
+	//running out of stock and a part too big for any board both throw
+	stock[small].count = 2;
+	CHECK(stock_plan(stock, 12, 900, cost, plan, sheet_stock));
+	CHECK(stock_plan(stock, 1, 2500, cost, plan, sheet_stock));
+
+	vector <stock_sheet> parsed;
+	parse_stock("2800 2070 -1 30\n\n1000 1000 5 20\n", parsed);
+	CHECK((parsed.size() == 2) && (parsed[1].count == 5) && (parsed[1].cost == 20));
+	bool threw = false;
+	try
+	{
+		parse_stock("2800 2070 -2 30\n", parsed);
+	}
+	catch (const runtime_error&)
+	{
+		threw = true;
+	}
+	CHECK(threw);
+}
+
+void test_remnant_store()
+{
+	string path = (filesystem::temp_directory_path() / "packer_tests.rmn").string();
+	filesystem::remove(path);
+	{
+		remnant_store store(path);
+		CHECK(store.size() == 0);
+		CHECK(store.find_smallest(10, 10) == -1);
+		uint32_t wide = store.add(1200, 300, 7);
+		uint32_t square = store.add(600, 600, 7);
+		uint32_t big = store.add(1500, 900, 8);
+		CHECK(store.find_smallest(500, 500) == square);
+		CHECK(store.find_largest(500, 500) == big);
+		//300 x 800 fits the wide one only turned
+		CHECK(store.find_smallest(300, 800) == wide);
+		CHECK(store.find_smallest(300, 800, false) == big);
+		//a taken remnant drops out of both queries at once
+		store.take(square);
+		CHECK(store.find_smallest(500, 500) == big);
+		store.take(big);
+		CHECK(store.find_largest(500, 500) == -1);
+		bool threw = false;
+		try
+		{
+			store.take(big);
+		}
+		catch (const runtime_error&)
+		{
+			threw = true;
+		}
+		CHECK(threw);
+		//more remnants than the first capacity grow the file
+		for (int i = 0; i < 100; ++i)
+			store.add(100 + i, 100, 9);
+		store.flush();
+	}
+	{
+		remnant_store store(path);
+		CHECK(store.size() == 103);
+		CHECK(store.is_used(1) && store.is_used(2) && !store.is_used(0));
+		CHECK((store.width(0) == 1200) && (store.height(0) == 300) && (store.source(2) == 8));
+		CHECK(store.find_largest(1100, 300) == 0);
+		CHECK(store.find_smallest(150, 100) == 53);
+		vector <stock_sheet> stock;
+		vector <uint32_t> ids;
+		store.inventory(0, stock, ids);
+		CHECK((stock.size() == 101) && (ids[0] == 0) && stock[0].remnant);
+	}
+	filesystem::remove(path);
+}
+
+//The stream packer on a seeded order against the offline shelf plan: every part is on exactly one
+//list, inside it and clear of the others, the sheet count stays within a quarter of the offline one
+//and the packer never holds the whole order
+void test_stream()
+{
+	int dsp_w = 2800, dsp_h = 2070, saw_width = 4;
+	vector <Rectangle> order = cast_input_vector(generate_order(3000, 1, UNIFORM, dsp_w, dsp_h));
+	vector <vector <Rectangle>> lists;
+	stream_packer packer(dsp_w, dsp_h, saw_width, [&](int list, span<const Rectangle> parts)
+	{
+		if (lists.size() <= list) lists.resize(list + 1);
+		lists[list].insert(lists[list].end(), parts.begin(), parts.end());
+	});
+	for (auto& r : order)
+		packer.add(r);
+	int stream_count = 0;
+	double stream_percentage = 0;
+	packer.finish(stream_count, stream_percentage);
+	CHECK(lists.size() == stream_count);
+	CHECK(packer.peak_parts() < order.size() / 4);
+
+	vector <int> seen(order.size(), 0);
+	for (int l = 0; l < lists.size(); ++l)
+	{
+		auto& parts = lists[l];
+		for (int i = 0; i < parts.size(); ++i)
+		{
+			const Rectangle& a = parts[i];
+			seen[a.id]++;
+			CHECK((a.dspN == l) && (a.x + a.width <= dsp_w + saw_width) && (a.y + a.height <= dsp_h + saw_width));
+			for (int j = i + 1; j < parts.size(); ++j)
+			{
+				const Rectangle& b = parts[j];
+				CHECK((a.x + a.width <= b.x) || (b.x + b.width <= a.x) || (a.y + a.height <= b.y) || (b.y + b.height <= a.y));
+			}
+		}
+	}
+	CHECK(count(seen.begin(), seen.end(), 1) == order.size());
+
+	vector <Rectangle> data = order;
+	fit_to_dsp(data, dsp_w, dsp_h);
+	pack_context ctx;
+	int offline_count = 0;
+	double offline_percentage = 0;
+	vector <Rectangle> plan;
+	pack(data, dsp_w, dsp_h, saw_width, SHELF, offline_count, offline_percentage, plan, ctx);
+	CHECK(stream_count >= ctx.sheet_bound);
+	CHECK(stream_count >= offline_count);
+	CHECK(stream_count * 4 <= offline_count * 5);
+}
+
+int main()
+{
+	test_fit_grain();
+	test_parse();
+	test_band_allowance();
+	test_engines();
+	test_bf_ties();
+	test_session_resize();
+	test_stock();
+	test_remnant_store();
+	test_stream();
+	if (failures)
+		cerr << failures << " checks failed" << endl;
+	return failures ? 1 : 0;
+}
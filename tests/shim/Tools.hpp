@@ -0,0 +1,21 @@
+#pragma once
+//Stands in for the app's Tools.hpp, which isn't in the tree, so the cluster headers build in tests/.
+//Scene units are mm / 320 like the _mm literals in Window.cpp. IObject is only pointed at by the
+//cluster code, tests derive their own objects from it
+#include <cmath>
+
+class IObject
+{
+public:
+    virtual ~IObject() = default;
+};
+
+inline float to_mm(int v)
+{
+    return v / 320.f;
+}
+
+inline int from_mm(float v)
+{
+    return (int)std::lround(v * 320);
+}
@@ -0,0 +1,19 @@
+#pragma once
+//Just enough of glm for the cluster headers to build without the glm submodule, see ../Tools.hpp
+
+namespace glm
+{
+struct ivec2
+{
+    int x = 0, y = 0;
+
+    ivec2() = default;
+    ivec2(int x, int y) : x(x), y(y) {}
+
+    int &operator[](int i) { return i ? y : x; }
+    const int &operator[](int i) const { return i ? y : x; }
+
+    bool operator==(const ivec2 &o) const { return x == o.x && y == o.y; }
+    bool operator!=(const ivec2 &o) const { return !(*this == o); }
+};
+}
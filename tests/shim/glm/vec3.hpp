@@ -0,0 +1,24 @@
+#pragma once
+//Just enough of glm for the cluster headers to build without the glm submodule, see ../Tools.hpp
+
+namespace glm
+{
+struct ivec3
+{
+    int x = 0, y = 0, z = 0;
+
+    ivec3() = default;
+    ivec3(int x, int y, int z) : x(x), y(y), z(z) {}
+};
+
+struct vec3
+{
+    float x = 0, y = 0, z = 0;
+
+    vec3() = default;
+    vec3(float x, float y, float z) : x(x), y(y), z(z) {}
+
+    vec3 operator+(const vec3 &o) const { return vec3(x + o.x, y + o.y, z + o.z); }
+    vec3 operator-(const vec3 &o) const { return vec3(x - o.x, y - o.y, z - o.z); }
+};
+}